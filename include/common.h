@@ -4,6 +4,7 @@
 /* Define structs and routine could be used by every source files */
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifndef OSCFG_H
 #include "os-cfg.h"
@@ -28,7 +29,10 @@ enum ins_opcode_t {
 	ALLOC,	// Allocate memory
 	FREE,	// Deallocated a memory block
 	READ,	// Write data to a byte on memory
-	WRITE	// Read data from a byte on memory
+	WRITE,	// Read data from a byte on memory
+	COPY,	// Copy a block of bytes between two regions
+	FILL,	// Set a block of bytes of a region to a value
+	CMP	// Compare a block of bytes of two regions
 };
 
 /* instructions executed by the CPU */
@@ -39,9 +43,18 @@ struct inst_t {
 	uint32_t arg_2;
 };
 
+struct pcb_t;
+
+/* Pre-decoded instruction handler, see cpu_decode() */
+typedef int (*ins_handler_t)(struct pcb_t * proc, const struct inst_t * ins);
+
 struct code_seg_t {
 	struct inst_t * text;
+	ins_handler_t * handler; // One handler per instruction of text
 	uint32_t size;
+	int refcnt; // Processes sharing the segment, see load()
+	void * map; // Mapping of a compiled program, text points in it
+	size_t map_len;
 };
 
 struct trans_table_t {
@@ -70,6 +83,7 @@ struct pcb_t {
 	struct code_seg_t * code;	// Code segment
 	addr_t regs[10]; // Registers, store address of allocated regions
 	uint32_t pc; // Program pointer, point to the next instruction
+	int cr; // Compare register, result of the last CMP (-1, 0 or 1)
 #ifdef MLQ_SCHED
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
@@ -9,5 +9,35 @@
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
+/* Execute up to [n] instructions of a process in a row. Return the
+ * number of instructions executed, less than [n] only if the process
+ * reached the end of its code. */
+int run_burst(struct pcb_t * proc, int n);
+
+/* Memory backend, the instruction set of one memory model. Every
+ * backend built in (CPU_TLB, MM_PAGING and the legacy one) can be
+ * picked at startup, its handlers are bound to the code at decode
+ * time so that each one keeps its own fast path. */
+struct mem_backend_t {
+	const char * name;
+	int paging; /* Processes need an mm and the MEMPHY devices */
+	ins_handler_t alloc, free, read, write, copy, fill, cmp;
+};
+
+/* Backend called name, NULL if it is not built in */
+const struct mem_backend_t * cpu_find_backend(const char * name);
+
+/* Most capable backend built in, among the paging ones or not */
+const struct mem_backend_t * cpu_default_backend(int paging);
+
+/* Select the backend of every code segment decoded from now on */
+void cpu_set_backend(const struct mem_backend_t * backend);
+
+const struct mem_backend_t * cpu_backend(void);
+
+/* Bind each instruction of a code segment to its handler for the
+ * selected memory backend. Called once by the loader. */
+void cpu_decode(struct code_seg_t * code);
+
 #endif
 
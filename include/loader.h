@@ -5,5 +5,8 @@
 
 struct pcb_t * load(const char * path);
 
+/* Release the reference of a finished process on its code segment */
+void code_put(struct code_seg_t * code);
+
 #endif
 
@@ -0,0 +1,45 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "os-cfg.h"
+
+/* Lock contention profiler, enabled by LOCK_PROF. Every MUTEX_LOCK
+ * call site counts its acquisitions, the contended ones with their
+ * wait time, and the hold time until the matching MUTEX_UNLOCK. */
+
+/* Wait time histogram, bucket k counts waits of [2^k, 2^(k+1)) ns */
+#define LOCKPROF_NR_BUCKETS	32
+
+struct lockprof_site {
+	const char * lock;
+	const char * file;
+	int line;
+	int registered;
+	uint64_t nr_acq;
+	uint64_t nr_contended;
+	uint64_t wait_ns, max_wait_ns;
+	uint64_t hold_ns, max_hold_ns;
+	uint64_t hist[LOCKPROF_NR_BUCKETS];
+	struct lockprof_site * next;
+};
+
+void lockprof_lock(pthread_mutex_t * m, struct lockprof_site * site);
+void lockprof_unlock(pthread_mutex_t * m);
+void lockprof_dump(FILE * out);
+
+#ifdef LOCK_PROF
+#define MUTEX_LOCK(m) do { \
+	static struct lockprof_site lockprof_site_ = \
+		{ #m, __FILE__, __LINE__ }; \
+	lockprof_lock(m, &lockprof_site_); \
+} while (0)
+#define MUTEX_UNLOCK(m) lockprof_unlock(m)
+#else
+#define MUTEX_LOCK(m) pthread_mutex_lock(m)
+#define MUTEX_UNLOCK(m) pthread_mutex_unlock(m)
+#endif
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef MM_H
 
 #include "bitops.h"
+#include <pthread.h>
 #include "common.h"
 
 #ifndef TLB_SIZE
@@ -10,71 +11,123 @@
 #define PAGESIZE 4096
 #define INVALID_FRAME_NUM -1
 
-/* CPU Bus definition */
+/* CPU Bus definition, the virtual address width. Addresses travel in the
+ * 32-bit operands of the instructions, see os-cfg.h to widen it */
+#ifndef PAGING_CPU_BUS_WIDTH
 #define PAGING_CPU_BUS_WIDTH 22 /* 22bit bus - MAX SPACE 4MB */
-#define PAGING_PAGESZ  256      /* 256B or 8-bits PAGE NUMBER */
+#endif
+#if PAGING_CPU_BUS_WIDTH > 32
+#error "PAGING_CPU_BUS_WIDTH above 32 bits is not supported"
+#endif
+#define PAGING_ADDR_MASK GENMASK(PAGING_CPU_BUS_WIDTH - 1, 0)
+
+/* Page size, selected per run by paging_set_pagesz(), a power of 2 */
+#define PAGING_PAGESZ_MIN 256   /* 8-bits PAGE OFFSET */
+#define PAGING_PAGESZ_MAX 4096  /* 12-bits PAGE OFFSET */
+#define PAGING_PAGESZ_DEF 256
+#define PAGING_PAGESZ  (paging_geom->pagesz)
+#define PAGING_PAGE_SHIFT (paging_geom->shift)
 #define PAGING_MEMRAMSZ BIT(10) /* 1MB */
 #define PAGING_PAGE_ALIGNSZ(sz) (DIV_ROUND_UP(sz,PAGING_PAGESZ)*PAGING_PAGESZ)
 
 #define PAGING_MEMSWPSZ BIT(14) /* 16MB */
 #define PAGING_SWPFPN_OFFSET 5  
-#define PAGING_MAX_PGN  (DIV_ROUND_UP(BIT(PAGING_CPU_BUS_WIDTH),PAGING_PAGESZ))
+#define PAGING_MAX_PGN  (paging_geom->maxpgn)
 
 #define PAGING_SBRK_INIT_SZ PAGING_PAGESZ
 /* PTE BIT */
-#define PAGING_PTE_PRESENT_MASK BIT(31) 
-#define PAGING_PTE_SWAPPED_MASK BIT(30)
-#define PAGING_PTE_RESERVE_MASK BIT(29)
-#define PAGING_PTE_DIRTY_MASK BIT(28)
-#define PAGING_PTE_EMPTY01_MASK BIT(14)
-#define PAGING_PTE_EMPTY02_MASK BIT(13)
+#define PAGING_PTE_PRESENT_MASK BIT_ULL(63)
+#define PAGING_PTE_SWAPPED_MASK BIT_ULL(62)
+#define PAGING_PTE_RESERVE_MASK BIT_ULL(61)
+#define PAGING_PTE_DIRTY_MASK BIT_ULL(60)
+#define PAGING_PTE_EMPTY01_MASK BIT_ULL(59)
+#define PAGING_PTE_EMPTY02_MASK BIT_ULL(58)
+#define PAGING_PTE_EMPTY03_MASK BIT_ULL(57)
 
 /* PTE BIT PRESENT */
-#define PAGING_PTE_SET_PRESENT(pte) (pte=pte|PAGING_PTE_PRESENT_MASK)
-#define PAGING_PAGE_PRESENT(pte) (pte&PAGING_PTE_PRESENT_MASK)
+#define PAGING_PTE_SET_PRESENT(pte) ((pte)=(pte)|PAGING_PTE_PRESENT_MASK)
+#define PAGING_PAGE_PRESENT(pte) ((pte)&PAGING_PTE_PRESENT_MASK)
+/* PTE BIT READ-AHEAD, online page prefetched but not touched yet */
+#define PAGING_PTE_RAHEAD_MASK PAGING_PTE_EMPTY01_MASK
+/* PTE BIT HOT, online page which has been swapped in before */
+#define PAGING_PTE_HOT_MASK PAGING_PTE_EMPTY02_MASK
+/* PTE BIT SWAPPED */
+#define PAGING_PAGE_SWAPPED(pte) ((pte)&PAGING_PTE_SWAPPED_MASK)
+/* PTE BIT HUGE, page of an aligned run of PAGING_HUGE_NR pages backed by
+ * contiguous frames, see MM_HUGEPAGE */
+#define PAGING_PTE_HUGE_MASK PAGING_PTE_RESERVE_MASK
+#define PAGING_PAGE_HUGE(pte) ((pte)&PAGING_PTE_HUGE_MASK)
+/* PTE BIT CHANGED, listed in pgd_chg_list since the last print_pgtbl_delta */
+#define PAGING_PTE_CHANGED_MASK PAGING_PTE_EMPTY03_MASK
 
 /* USRNUM */
-#define PAGING_PTE_USRNUM_LOBIT 15
-#define PAGING_PTE_USRNUM_HIBIT 27
+#define PAGING_PTE_USRNUM_LOBIT 45
+#define PAGING_PTE_USRNUM_HIBIT 56
 /* FPN */
 #define PAGING_PTE_FPN_LOBIT 0
-#define PAGING_PTE_FPN_HIBIT 12
+#define PAGING_PTE_FPN_HIBIT 39
 /* SWPTYP */
 #define PAGING_PTE_SWPTYP_LOBIT 0
 #define PAGING_PTE_SWPTYP_HIBIT 4
 /* SWPOFF */
 #define PAGING_PTE_SWPOFF_LOBIT 5
-#define PAGING_PTE_SWPOFF_HIBIT 25
+#define PAGING_PTE_SWPOFF_HIBIT 44
 
 /* PTE masks */
-#define PAGING_PTE_USRNUM_MASK GENMASK(PAGING_PTE_USRNUM_HIBIT,PAGING_PTE_USRNUM_LOBIT)
-#define PAGING_PTE_FPN_MASK    GENMASK(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
-#define PAGING_PTE_SWPTYP_MASK GENMASK(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
-#define PAGING_PTE_SWPOFF_MASK GENMASK(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+#define PAGING_PTE_USRNUM_MASK GENMASK_ULL(PAGING_PTE_USRNUM_HIBIT,PAGING_PTE_USRNUM_LOBIT)
+#define PAGING_PTE_FPN_MASK    GENMASK_ULL(PAGING_PTE_FPN_HIBIT,PAGING_PTE_FPN_LOBIT)
+#define PAGING_PTE_SWPTYP_MASK GENMASK_ULL(PAGING_PTE_SWPTYP_HIBIT,PAGING_PTE_SWPTYP_LOBIT)
+#define PAGING_PTE_SWPOFF_MASK GENMASK_ULL(PAGING_PTE_SWPOFF_HIBIT,PAGING_PTE_SWPOFF_LOBIT)
+
+/* Extract PTE fields */
+#define PAGING_PTE_FPN(pte)    GETVAL(pte,PAGING_PTE_FPN_MASK,PAGING_PTE_FPN_LOBIT)
+#define PAGING_PTE_SWPTYP(pte) GETVAL(pte,PAGING_PTE_SWPTYP_MASK,PAGING_PTE_SWPTYP_LOBIT)
+#define PAGING_PTE_SWPOFF(pte) GETVAL(pte,PAGING_PTE_SWPOFF_MASK,PAGING_PTE_SWPOFF_LOBIT)
+
+/* Physical address of a frame, 64-bit whatever the type of fpn */
+#define PAGING_FRAME_ADDR(fpn) ((addr_t)(fpn) << PAGING_PAGE_SHIFT)
+/* Largest MEMPHY device, frame numbers are int */
+#define PAGING_MEMPHY_MAXSZ PAGING_FRAME_ADDR(BIT_ULL(31))
+
+/* Page table, a directory of PTE tables allocated on first use so that
+ * the table of a sparse bus space stays small */
+#define PAGING_PTBL_SHIFT 10
+#define PAGING_PTBL_NR BIT(PAGING_PTBL_SHIFT)
+#define PAGING_PGD_NR DIV_ROUND_UP(PAGING_MAX_PGN, PAGING_PTBL_NR)
+/* PTE of page pgn, an lvalue, its table is allocated on the way */
+#define PAGING_PTE(mm,pgn) (*((mm)->pgd[(pgn) >> PAGING_PTBL_SHIFT] != NULL ? \
+      &(mm)->pgd[(pgn) >> PAGING_PTBL_SHIFT][(pgn) & (PAGING_PTBL_NR - 1)] : \
+      pte_alloc((mm), (pgn))))
+/* PTE value of page pgn for read paths, 0 when out of the bus space or
+ * when its table was never allocated */
+#define PAGING_PTE_LOOKUP(mm,pgn) \
+      ((pgn) >= 0 && (pgn) < PAGING_MAX_PGN && \
+       (mm)->pgd[(pgn) >> PAGING_PTBL_SHIFT] != NULL ? \
+       (mm)->pgd[(pgn) >> PAGING_PTBL_SHIFT][(pgn) & (PAGING_PTBL_NR - 1)] : (pte_t)0)
 
 /* OFFSET */
 #define PAGING_ADDR_OFFST_LOBIT 0
-#define PAGING_ADDR_OFFST_HIBIT (NBITS(PAGING_PAGESZ) - 1)
+#define PAGING_ADDR_OFFST_HIBIT (PAGING_PAGE_SHIFT - 1)
 
 /* PAGE Num */
-#define PAGING_ADDR_PGN_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_ADDR_PGN_LOBIT PAGING_PAGE_SHIFT
 #define PAGING_ADDR_PGN_HIBIT (PAGING_CPU_BUS_WIDTH - 1)
 
 /* Frame PHY Num */
-#define PAGING_ADDR_FPN_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_ADDR_FPN_LOBIT PAGING_PAGE_SHIFT
 #define PAGING_ADDR_FPN_HIBIT (NBITS(PAGING_MEMRAMSZ) - 1)
 
 /* SWAPFPN */
-#define PAGING_SWP_LOBIT NBITS(PAGING_PAGESZ)
+#define PAGING_SWP_LOBIT PAGING_PAGE_SHIFT
 #define PAGING_SWP_HIBIT (NBITS(PAGING_MEMSWPSZ) - 1)
 #define PAGING_SWP(pte) ((pte&PAGING_SWP_MASK) >> PAGING_SWPFPN_OFFSET)
 
 /* Value operators */
-#define SETBIT(v,mask) (v=v|mask)
-#define CLRBIT(v,mask) (v=v&~mask)
+#define SETBIT(v,mask) ((v)=(v)|(mask))
+#define CLRBIT(v,mask) ((v)=(v)&~(mask))
 
-#define SETVAL(v,value,mask,offst) (v=(v&~mask)|((value<<offst)&mask))
-#define GETVAL(v,mask,offst) ((v&mask)>>offst)
+#define SETVAL(v,value,mask,offst) ((v)=((v)&~(mask))|(((value)<<(offst))&(mask)))
+#define GETVAL(v,mask,offst) (((v)&(mask))>>(offst))
 
 /* Other masks */
 #define PAGING_OFFST_MASK  GENMASK(PAGING_ADDR_OFFST_HIBIT,PAGING_ADDR_OFFST_LOBIT)
@@ -94,6 +147,72 @@
 /* Extract SWAPTYPE */
 #define PAGING_FPN(x)  GETVAL(x,PAGING_FPN_MASK,PAGING_ADDR_FPN_LOBIT)
 
+/* KSWAPD watermarks, in percent of MEMRAM frames */
+#define PAGING_WMARK_LOW_PCT  10
+#define PAGING_WMARK_HIGH_PCT 20
+#define PAGING_WMARK(nfp,pct) DIV_ROUND_UP((nfp)*(pct),100)
+/* Max frames reclaimed by kswapd in one time slot */
+#define PAGING_KSWAPD_BATCH 32
+
+/* MEMPHY storage backing */
+#define MEMPHY_BACKING_HEAP 0
+#define MEMPHY_BACKING_FILE 1
+#define MEMPHY_BACKING_ANON 2
+/* Backing file of MEMSWP devices with MM_SWPFILE, by device index */
+#define PAGING_SWPFILE_FMT "MEMSWP%d.bin"
+
+/* Binary MEMPHY dump: a memphy_dump_hdr, then per changed frame a
+ * memphy_dump_rec followed by the page content */
+#define MEMPHY_DUMP_FILE "RAM_status.bin"
+#define MEMPHY_DUMP_MAGIC 0x504d444d /* "MDMP" */
+
+struct memphy_dump_hdr {
+   uint32_t magic;
+   uint32_t pagesz;
+};
+
+struct memphy_dump_rec {
+   uint32_t seq; /* MEMPHY_dump call the frame was written by */
+   uint32_t fpn;
+};
+
+/* ZSWAP pool, in percent of MEMRAM frames, and the largest accepted
+ * compressed size, in percent of a page */
+#define PAGING_ZSWAP_MAX_PCT   20
+#define PAGING_ZSWAP_MAX_RATIO 75
+/* Swap type of a page held by the ZSWAP pool, after the MEMSWP devices */
+#define PAGING_SWPTYP_ZSWAP PAGING_MAX_MMSWP
+
+/* Base pages of a huge page, a power of 2 */
+#define PAGING_HUGE_NR 16
+#define PAGING_HUGE_PGN(pgn) ((pgn) & ~(PAGING_HUGE_NR - 1))
+
+/* Max pages prefetched from MEMSWP on a sequential fault */
+#define PAGING_RA_MAX_WIN 8
+
+/* Tries to get both pages of a two region block instruction online */
+#define PAGING_PAIR_RETRY 4
+
+/* Page geometry of the run. The byte and range access paths are built
+ * once per supported page size, with the address split folded to
+ * constants */
+struct paging_geom_t {
+   int pagesz;
+   int shift;  /* log2 of pagesz */
+   int maxpgn; /* pages of the CPU bus space */
+   int (*getval)(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *caller);
+   int (*setval)(struct mm_struct *mm, addr_t addr, BYTE value, struct pcb_t *caller);
+   int (*rwrange)(struct mm_struct *mm, addr_t addr, BYTE *buf, int len, int wr,
+                  struct pcb_t *caller);
+};
+
+extern const struct paging_geom_t *paging_geom;
+
+/* Non zero to run without the IODUMP trace, set once before the CPUs
+ * start */
+extern int iodump_quiet;
+int paging_set_pagesz(int pagesz);
+
 /* Memory range operator */
 #define INCLUDE(x1,x2,y1,y2) (((y1-x1)*(x2-y2)>=0)?1:0)
 #define OVERLAP(x1,x2,y1,y2) (((y2-x1)*(x2-y1)>=0)?1:0)
@@ -102,14 +221,17 @@
 struct vm_rg_struct * init_vm_rg(int rg_start, int rg_endi);
 int enlist_vm_rg_node(struct vm_rg_struct **rglist, struct vm_rg_struct* rgnode);
 int enlist_pgn_node(struct pgn_t **pgnlist, int pgn);
+int delist_pgn_node(struct pgn_t **pgnlist, int pgn);
 int vmap_page_range(struct pcb_t *caller, int addr, int pgnum, struct framephy_struct *frames, struct vm_rg_struct *ret_rg, struct framephy_struct *frm_lst_swap);
 int vm_map_ram(struct pcb_t *caller, int astart, int send, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg);
 int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst, struct framephy_struct **frm_lst_swap);
 int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                 struct memphy_struct *mpdst, int dstfpn) ;
-int pte_set_fpn(uint32_t *pte, int fpn);
-int pte_set_swap(uint32_t *pte, int swptyp, int swpoff);
-int init_pte(uint32_t *pte,
+int pte_set_fpn(pte_t *pte, int fpn);
+int pte_set_swap(pte_t *pte, int swptyp, int swpoff);
+int pte_split_huge(struct mm_struct *mm, int pgn);
+pte_t *pte_alloc(struct mm_struct *mm, int pgn);
+int init_pte(pte_t *pte,
              int pre,    // present
              int fpn,    // FPN
              int drt,    // dirty
@@ -120,6 +242,8 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
 int __free(struct pcb_t *caller, int vmaid, int rgid);
 int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value);
+int __read_range(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *buf, int size);
+int __write_range(struct pcb_t *caller, int vmaid, int rgid, int offset, const BYTE *buf, int size);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
 
 /* CPUTLB prototypes */
@@ -127,9 +251,11 @@ int tlb_change_all_page_tables_of(struct pcb_t *proc,  struct memphy_struct * mp
 int tlb_flush_tlb_of(struct pcb_t *proc, struct memphy_struct * mp);
 int tlballoc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
 int tlbfree_data(struct pcb_t *proc, uint32_t reg_index);
-int tlbread(struct pcb_t * proc, uint32_t source, uint32_t offset, uint32_t destination) ;
+int tlbread(struct pcb_t * proc, uint32_t source, uint32_t offset, uint32_t *destination);
 int tlbwrite(struct pcb_t * proc, BYTE data, uint32_t destination, uint32_t offset);
 int init_tlbmemphy(struct memphy_struct *mp, int max_size);
+int tlb_cache_read(struct memphy_struct *mp, uint32_t addr, uint32_t *value);
+int tlb_cache_write(struct memphy_struct *mp, uint32_t addr, uint32_t value);
 int TLBMEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int TLBMEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
 int TLBMEMPHY_dump(struct memphy_struct * mp);
@@ -147,21 +273,60 @@ int pgwrite(
 		BYTE data, // Data to be wrttien into memory
 		uint32_t destination, // Index of destination register
 		uint32_t offset);
+int pgcopy(struct pcb_t *proc, uint32_t source, uint32_t destination, uint32_t size);
+int pgfill(struct pcb_t *proc, BYTE data, uint32_t destination, uint32_t size);
+int pgcmp(struct pcb_t *proc, uint32_t source, uint32_t destination, uint32_t size);
 /* Local VM prototypes */
 struct vm_rg_struct * get_symrg_byid(struct mm_struct* mm, int rgid);
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int vmaend);
 int get_free_vmrg_area(struct pcb_t *caller, int vmaid, int size, struct vm_rg_struct *newrg);
 int inc_vma_limit(struct pcb_t *caller, int vmaid, int inc_sz);
 int find_victim_page(struct pcb_t *caller, struct mm_struct *mm, int *pgn);
+int pg_swapout(struct pcb_t *caller, int vicpgn, int *retfpn);
 struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
+int pg_getval(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *caller);
+int pg_setval(struct mm_struct *mm, addr_t addr, BYTE value, struct pcb_t *caller);
 
 /* MEM/PHY protypes */
+extern pthread_mutex_t lock_mem;
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nr, int *retfpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
-int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
-int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
+int MEMPHY_read(struct memphy_struct * mp, addr_t addr, BYTE *value);
+int MEMPHY_write(struct memphy_struct * mp, addr_t addr, BYTE data);
+int MEMPHY_read_block(struct memphy_struct *mp, addr_t addr, BYTE *buf, int len);
+int MEMPHY_write_block(struct memphy_struct *mp, addr_t addr, const BYTE *buf, int len);
+int MEMPHY_copy_block(struct memphy_struct *mp, addr_t dst, addr_t src, int len);
+int MEMPHY_set_block(struct memphy_struct *mp, addr_t addr, BYTE value, int len);
+int MEMPHY_cmp_block(struct memphy_struct *mp, addr_t addr0, addr_t addr1, int len, int *res);
 int MEMPHY_dump(struct memphy_struct * mp);
-int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
+int MEMPHY_mark_dirty(struct memphy_struct *mp, int fpn);
+int MEMPHY_cp_frames(struct memphy_struct *mpsrc, int *srcfpn,
+                     struct memphy_struct *mpdst, int *dstfpn, int nr);
+int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg);
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg, const char *path);
+
+/* SWAP manager prototypes */
+int init_swap(struct memphy_struct *mswp, int nr);
+struct memphy_struct *swap_dev(int swptyp);
+int swap_get_freefp(int hot, int *swptyp, int *fpn);
+int swap_put_freefp(int swptyp, int fpn);
+int print_swap(void);
+
+/* ZSWAP prototypes */
+int init_zswap(struct memphy_struct *mram);
+int zswap_store(struct mm_struct *mm, int pgn, int fpn, int *retidx);
+int zswap_load(int idx, struct memphy_struct *mp, int fpn);
+int zswap_release(struct mm_struct *mm);
+int print_zswap(void);
+
+/* KSWAPD prototypes */
+int free_pcb_memph(struct pcb_t *caller);
+int kswapd_register(struct pcb_t *proc);
+int kswapd_unregister(struct pcb_t *proc);
+int kswapd_nr_proc(void);
+int kswapd_balance(struct memphy_struct *mram);
+int kswapd_steal_frame(struct pcb_t *caller, int *retfpn);
 /* DEBUG */
 int print_list_fp(struct framephy_struct *fp);
 int print_list_rg(struct vm_rg_struct *rg);
@@ -169,5 +334,8 @@ int print_list_vma(struct vm_area_struct *rg);
 
 
 int print_list_pgn(struct pgn_t *ip);
+int print_swap_ra(struct mm_struct *mm);
 int print_pgtbl(struct pcb_t *ip, uint32_t start, uint32_t end);
+int print_pgtbl_delta(struct pcb_t *ip);
+int pte_changed(struct mm_struct *mm, int pgn);
 #endif
@@ -7,10 +7,21 @@
 #define CPU_TLB
 #define CPUTLB_FIXED_TLBSZ
 #define MM_PAGING
+//#define MM_KSWAPD
+//#define MM_SWAP_RA
+//#define MM_HUGEPAGE
+//#define MM_ZSWAP
+//#define MM_SWP_TIERED
+//#define MM_SWPFILE
 //#define MM_FIXED_MEMSZ
+//#define PAGING_CPU_BUS_WIDTH 32
 //#define VMDBG 1
 //#define MMDBG 1
 #define IODUMP 1
 #define PAGETBL_DUMP 1
+//#define PAGETBL_DUMP_FULL 1
+#define OS_STATS 1
+//#define OS_TRACE 1
+//#define LOCK_PROF 1
 
 #endif
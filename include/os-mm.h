@@ -1,12 +1,15 @@
 #ifndef OSMM_H
 #define OSMM_H
 
+#include <sys/types.h> /* pthread_mutex_t */
+
 #define MM_PAGING
 #define PAGING_MAX_MMSWP 4 /* max number of supported swapped space */
 #define PAGING_MAX_SYMTBL_SZ 30
 
 typedef char BYTE;
-typedef uint32_t addr_t;
+typedef uint64_t addr_t;
+typedef uint64_t pte_t;
 //typedef unsigned int uint32_t;
 
 struct pgn_t{
@@ -42,11 +45,25 @@ struct vm_area_struct {
    struct vm_area_struct *vm_next;
 };
 
+/*
+ *  Swap read-ahead state and counters
+ */
+struct swap_ra_struct {
+   int win;      /* pages prefetched on the next fault */
+   int last_pgn; /* last faulted page */
+   int next_pgn; /* first page after the last read-ahead window */
+
+   unsigned long nr_fault;
+   unsigned long nr_issued;
+   unsigned long nr_hit;
+   unsigned long nr_wasted;
+};
+
 /* 
  * Memory management struct
  */
 struct mm_struct {
-   uint32_t *pgd;
+   pte_t **pgd; /* PAGING_PGD_NR tables of PAGING_PTBL_NR PTEs */
 
    struct vm_area_struct *mmap;
 
@@ -57,6 +74,19 @@ struct mm_struct {
 	struct page_table_t *page_table; // Page table
 
    struct pgn_t *fifo_pgn;
+
+   struct swap_ra_struct swap_ra;
+
+   /* PTEs changed since the last print_pgtbl_delta */
+   int *pgd_chg_list;
+   int nr_pgd_chg;
+   int max_pgd_chg;
+
+   /* Registration in kswapd, NULL if not reclaimable */
+   struct kswapd_node *kswapd;
+
+   /* Serialize page table updates between the owner and kswapd */
+   pthread_mutex_t lock;
 };
 
 /*
@@ -68,20 +98,32 @@ struct framephy_struct {
 
    /* Resereed for tracking allocated framed */
    struct mm_struct* owner;
+
+   /* Swap type (MEMSWP index) of a frame taken from swap */
+   int swptyp;
 };
 
 struct memphy_struct {
    /* Basic field of data and size */
    BYTE *storage;
-   int maxsz;
+   addr_t maxsz;
+   int backing; /* MEMPHY_BACKING_* kind of storage */
    
    /* Sequential device fields */ 
    int rdmflg;
-   int cursor;
+   addr_t cursor;
 
    /* Management structure */
    struct framephy_struct *free_fp_list;
    struct framephy_struct *used_fp_list;
+   int free_fp_cnt;
+   int free_fp_csr; /* first never used frame */
+   int numfp;
+
+   /* Frames changed since the last dump */
+   uint32_t *dirty_map;
+   int *dirty_list;
+   int nr_dirty;
 };
 
 #endif
@@ -0,0 +1,28 @@
+#ifndef PROG_H
+#define PROG_H
+
+#include "common.h"
+
+/* Compiled program: a prog_hdr_t followed by [size] packed inst_t.
+ * Produced from the text format by progc, mapped as is by prog_load */
+#define PROG_MAGIC	0x4250534f /* "OSPB" */
+#define PROG_VERSION	1
+
+struct prog_hdr_t {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t priority;
+	uint32_t size; // Number of instructions
+};
+
+/* Read a program, text or compiled, into a new code segment and its
+ * default priority. Return NULL if the file cannot be read */
+struct code_seg_t * prog_load(const char * path, uint32_t * priority);
+
+/* Save a code segment in the compiled format. Return 0 on success */
+int prog_write(const char * path, struct code_seg_t * code, uint32_t priority);
+
+/* Free the instructions and the segment itself */
+void prog_release(struct code_seg_t * code);
+
+#endif
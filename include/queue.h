@@ -3,11 +3,15 @@
 
 #include "common.h"
 
+/* Initial capacity, a queue grows when full */
 #define MAX_QUEUE_SIZE 10
 
+/* Ring of processes, the oldest one at index head */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;
+	int head;
 	int size;
+	int cap;
 
 	unsigned int slot;
 };
@@ -1,5 +1,5 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
 
@@ -7,13 +7,19 @@
 #define MLQ_SCHED
 #endif
 
+#ifndef MAX_PRIO
 #define MAX_PRIO 139
+#endif
 
 int queue_empty(void);
 
 void init_scheduler(void);
 void finish_scheduler(void);
 
+#ifdef MLQ_SCHED
+struct pcb_t * get_mlq_proc(void);
+#endif
+
 /* Get the next process from ready queue */
 struct pcb_t * get_proc(void);
 
@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/* Chrome trace-event export of the simulation, enabled by OS_TRACE.
+ * The file is a JSON array of events which chrome://tracing and
+ * Perfetto open directly. Timestamps are time slots, one slot shows as
+ * TRACE_SLOT_US microseconds. */
+#define TRACE_FILE	"trace.json"
+#define TRACE_SLOT_US	1000
+
+/* Track groups: CPUs, loader and kswapd under "os", memory events of
+ * each process on its own track under "processes" */
+#define TRACE_PID_OS		0
+#define TRACE_PID_PROC		1
+#define TRACE_TID_LOADER	1000
+#define TRACE_TID_KSWAPD	1001
+
+struct pcb_t;
+
+int trace_open(const char * path);
+
+void trace_close(void);
+
+/* Name the track tid of group pid */
+void trace_name(int pid, int tid, const char * fmt, ...);
+
+/* Process proc starts or stops running on a CPU */
+void trace_run_begin(int cpu, struct pcb_t * proc);
+void trace_run_end(int cpu, const char * why);
+
+/* Instant event, args formats the members of the args object */
+void trace_instant(int pid, int tid, const char * cat, const char * name,
+		const char * args, ...);
+
+#endif
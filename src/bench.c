@@ -0,0 +1,394 @@
+/*
+ * Microbenchmarks of the simulator hot paths
+ *
+ *   bench [-r rounds] [-b batch] [-p pagesz] [filter]
+ *
+ * Each benchmark is timed in rounds of a batch of operations; the mean
+ * is reported with the percentiles of the per-round ns/op. Page faults
+ * and the timer barrier are slow enough to be timed one by one. Only benchmarks whose name
+ * contains filter are run.
+ *
+ *   -r rounds      timed rounds per benchmark (default 200)
+ *   -b batch       operations per round (default 1000)
+ *   -p pagesz      page size of the paging benchmarks (default 256)
+ */
+
+#include "queue.h"
+#include "sched.h"
+#include "timer.h"
+#include "mm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+
+#define BENCH_MAX_CPUS	64
+
+static int rounds = 200;
+static int batch = 1000;
+static const char * filter = NULL;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* The simulator logs on stdout, keep it out of the report */
+static int saved_stdout = -1;
+
+static void quiet(int on) {
+	fflush(stdout);
+	if (on) {
+		int fd = open("/dev/null", O_WRONLY);
+		saved_stdout = dup(1);
+		dup2(fd, 1);
+		close(fd);
+	} else if (saved_stdout >= 0) {
+		dup2(saved_stdout, 1);
+		close(saved_stdout);
+		saved_stdout = -1;
+	}
+}
+
+static int cmp_double(const void * a, const void * b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
+
+static int selected(const char * name) {
+	return filter == NULL || strstr(name, filter) != NULL;
+}
+
+/* Print mean and percentiles of n samples in ns/op */
+static void report(const char * name, double * ns, int n, double mean) {
+	qsort(ns, n, sizeof(double), cmp_double);
+	printf("%-28s %10.1f %10.1f %10.1f %10.1f %10.1f\n", name, mean,
+		ns[n / 2], ns[n * 90 / 100], ns[n * 99 / 100], ns[n - 1]);
+}
+
+/*bench_run - time rounds batches of an operation
+ *@name: benchmark name
+ *@op: runs the operation n times on ctx
+ *@ctx: benchmark state
+ *@nops: operations per round
+ */
+static void bench_run(const char * name, void (*op)(void *, int), void * ctx,
+                      int nops) {
+	double * ns = malloc(rounds * sizeof(double));
+	uint64_t total = 0;
+	int it;
+
+	if (!selected(name)) {
+		free(ns);
+		return;
+	}
+
+	quiet(1);
+	op(ctx, nops); /* Warm up */
+	for (it = 0; it < rounds; it++) {
+		uint64_t start = now_ns();
+		op(ctx, nops);
+		uint64_t spent = now_ns() - start;
+		ns[it] = (double)spent / nops;
+		total += spent;
+	}
+	quiet(0);
+
+	report(name, ns, rounds, (double)total / ((double)rounds * nops));
+	free(ns);
+}
+
+/* Queue: enqueue then dequeue at a steady occupancy */
+
+struct queue_ctx {
+	struct queue_t q;
+	struct pcb_t * pcb;
+};
+
+static void op_queue(void * arg, int n) {
+	struct queue_ctx * ctx = arg;
+	while (n--) {
+		enqueue(&ctx->q, ctx->pcb);
+		dequeue(&ctx->q);
+	}
+}
+
+static void bench_queue(void) {
+	static const int occupancy[] = { 0, 16, 256, 4096 };
+	struct queue_ctx ctx;
+	struct pcb_t pcb;
+	char name[64];
+	unsigned int it;
+	int k;
+
+	for (it = 0; it < sizeof(occupancy) / sizeof(occupancy[0]); it++) {
+		memset(&ctx, 0, sizeof(ctx));
+		ctx.pcb = &pcb;
+		for (k = 0; k < occupancy[it]; k++)
+			enqueue(&ctx.q, &pcb);
+		snprintf(name, sizeof(name), "queue/enq+deq/%d", occupancy[it]);
+		bench_run(name, op_queue, &ctx, batch);
+		free(ctx.q.proc);
+	}
+}
+
+/* MLQ: pick the next process and put it back, at a steady occupancy */
+
+static void op_mlq(void * arg, int n) {
+	struct pcb_t * proc;
+	while (n--) {
+		/* A round of the MLQ slots may end without a pick */
+		if ((proc = get_mlq_proc()) != NULL)
+			put_proc(proc);
+	}
+}
+
+static void bench_mlq(void) {
+	static const int occupancy[] = { 1, 16, 256, 4096 };
+	struct pcb_t * pcb;
+	char name[64];
+	unsigned int it;
+	int k;
+
+	init_scheduler();
+	for (it = 0; it < sizeof(occupancy) / sizeof(occupancy[0]); it++) {
+		pcb = calloc(occupancy[it], sizeof(struct pcb_t));
+		for (k = 0; k < occupancy[it]; k++) {
+			pcb[k].prio = k % MAX_PRIO;
+			add_proc(&pcb[k]);
+		}
+		snprintf(name, sizeof(name), "sched/get_mlq_proc/%d", occupancy[it]);
+		bench_run(name, op_mlq, NULL, batch);
+		while (!queue_empty())
+			get_proc();
+		free(pcb);
+	}
+}
+
+/* MEMPHY: take a free frame and give it back */
+
+static void op_freefp(void * arg, int n) {
+	struct memphy_struct * mp = arg;
+	int fpn;
+	while (n--) {
+		MEMPHY_get_freefp(mp, &fpn);
+		MEMPHY_put_freefp(mp, fpn);
+	}
+}
+
+/* Paging: a process with one region spanning pgnum pages */
+
+struct pg_ctx {
+	struct pcb_t proc;
+	int start;  /* First address of the region */
+	int pgnum;
+	int cur;    /* Next page accessed */
+	int stride; /* Pages between two accesses */
+};
+
+static void pg_setup(struct pg_ctx * ctx, struct memphy_struct * mram,
+                     struct memphy_struct * mswp, int pgnum, int stride) {
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->proc.mm = malloc(sizeof(struct mm_struct));
+	init_mm(ctx->proc.mm, &ctx->proc);
+	ctx->proc.mram = mram;
+	ctx->proc.mswp = (struct memphy_struct **)mswp;
+	ctx->proc.active_mswp = mswp;
+	ctx->pgnum = pgnum;
+	ctx->stride = stride;
+	__alloc(&ctx->proc, 0, 0, pgnum * PAGING_PAGESZ, &ctx->start);
+}
+
+static void pg_teardown(struct pg_ctx * ctx) {
+	free_pcb_memph(&ctx->proc);
+	free(ctx->proc.mm);
+}
+
+static int pg_next(struct pg_ctx * ctx) {
+	int addr = ctx->start + ctx->cur * PAGING_PAGESZ;
+	ctx->cur = (ctx->cur + ctx->stride) % ctx->pgnum;
+	return addr;
+}
+
+static void op_getval(void * arg, int n) {
+	struct pg_ctx * ctx = arg;
+	BYTE data;
+	while (n--)
+		pg_getval(ctx->proc.mm, pg_next(ctx), &data, &ctx->proc);
+}
+
+static void op_setval(void * arg, int n) {
+	struct pg_ctx * ctx = arg;
+	while (n--)
+		pg_setval(ctx->proc.mm, pg_next(ctx), (BYTE)n, &ctx->proc);
+}
+
+struct swpcp_ctx {
+	struct memphy_struct * src, * dst;
+	int nfp;
+	int cur;
+};
+
+static void op_swpcp(void * arg, int n) {
+	struct swpcp_ctx * ctx = arg;
+	while (n--) {
+		__swap_cp_page(ctx->src, ctx->cur, ctx->dst, ctx->cur);
+		ctx->cur = (ctx->cur + 1) % ctx->nfp;
+	}
+}
+
+static void bench_mm(void) {
+	struct memphy_struct mram, sram, mswp[PAGING_MAX_MMSWP];
+	struct pg_ctx pg;
+	struct swpcp_ctx cp;
+	int it;
+
+	init_memphy(&mram, PAGING_MEMRAMSZ * 1024, 1);
+	/* Small MEMRAM, so that every access of a larger region faults */
+	init_memphy(&sram, 16 * PAGING_PAGESZ, 1);
+	init_memphy(&mswp[0], PAGING_MEMSWPSZ * 1024, 1);
+	for (it = 1; it < PAGING_MAX_MMSWP; it++)
+		init_memphy(&mswp[it], 0, 1);
+	init_swap(mswp, PAGING_MAX_MMSWP);
+
+	bench_run("memphy/get+put_freefp", op_freefp, &mram, batch);
+
+	quiet(1);
+	pg_setup(&pg, &mram, mswp, 1, 1);
+	quiet(0);
+	bench_run("vm/pg_getval/hit", op_getval, &pg, batch);
+	bench_run("vm/pg_setval/hit", op_setval, &pg, batch);
+	quiet(1);
+	pg_teardown(&pg);
+
+	/* Walk the pages backwards, read-ahead only follows forward faults */
+	pg_setup(&pg, &sram, mswp, 64, 64 - 1);
+	quiet(0);
+	bench_run("vm/pg_getval/fault", op_getval, &pg, 1);
+	bench_run("vm/pg_setval/fault", op_setval, &pg, 1);
+	quiet(1);
+	pg_teardown(&pg);
+	quiet(0);
+
+	cp.src = &mram;
+	cp.dst = &mswp[0];
+	cp.nfp = 256 * 1024 / PAGING_PAGESZ; /* 256KB whatever the page size */
+	cp.cur = 0;
+	bench_run("mm/__swap_cp_page", op_swpcp, &cp, batch);
+}
+
+/* TLB: direct mapped lookup over a spread of pages */
+
+struct tlb_ctx {
+	struct memphy_struct tlb;
+	uint32_t addr;
+};
+
+static void op_tlb(void * arg, int n) {
+	struct tlb_ctx * ctx = arg;
+	uint32_t value;
+	while (n--) {
+		tlb_cache_read(&ctx->tlb, ctx->addr, &value);
+		ctx->addr += PAGESIZE * 7;
+	}
+}
+
+static void bench_tlb(void) {
+	struct tlb_ctx ctx;
+
+	memset(&ctx, 0, sizeof(ctx));
+	init_tlbmemphy(&ctx.tlb, TLB_SIZE);
+	bench_run("tlb/tlb_cache_read", op_tlb, &ctx, batch);
+}
+
+/* Timer: latency of next_slot with all CPUs in lockstep */
+
+struct slot_args {
+	struct timer_id_t * timer_id;
+	double * ns;
+};
+
+static void * slot_routine(void * arg) {
+	struct slot_args * args = arg;
+	int it;
+
+	for (it = 0; it < rounds; it++) {
+		uint64_t start = now_ns();
+		next_slot(args->timer_id);
+		args->ns[it] = (double)(now_ns() - start);
+	}
+	detach_event(args->timer_id);
+	return NULL;
+}
+
+static void bench_slot(void) {
+	static struct slot_args args[BENCH_MAX_CPUS];
+	pthread_t cpu[BENCH_MAX_CPUS];
+	double * ns, total;
+	char name[64];
+	int ncpu, it;
+
+	for (ncpu = 1; ncpu <= BENCH_MAX_CPUS; ncpu *= 2) {
+		snprintf(name, sizeof(name), "timer/next_slot/%d", ncpu);
+		if (!selected(name))
+			continue;
+
+		ns = malloc((size_t)ncpu * rounds * sizeof(double));
+		for (it = 0; it < ncpu; it++) {
+			args[it].timer_id = attach_event();
+			args[it].ns = ns + (size_t)it * rounds;
+		}
+
+		quiet(1);
+		start_timer();
+		for (it = 0; it < ncpu; it++)
+			pthread_create(&cpu[it], NULL, slot_routine, &args[it]);
+		for (it = 0; it < ncpu; it++)
+			pthread_join(cpu[it], NULL);
+		stop_timer();
+		quiet(0);
+
+		total = 0;
+		for (it = 0; it < ncpu * rounds; it++)
+			total += ns[it];
+		report(name, ns, ncpu * rounds, total / (ncpu * rounds));
+		free(ns);
+	}
+}
+
+int main(int argc, char * argv[]) {
+	int c;
+
+	int pagesz = PAGING_PAGESZ_DEF;
+
+	while ((c = getopt(argc, argv, "r:b:p:h")) != -1) {
+		switch (c) {
+		case 'r': rounds = atoi(optarg); break;
+		case 'b': batch = atoi(optarg); break;
+		case 'p': pagesz = atoi(optarg); break;
+		default:
+			printf("Usage: bench [-r rounds] [-b batch] [-p pagesz] [filter]\n");
+			return 1;
+		}
+	}
+	if (rounds < 1 || batch < 1 || paging_set_pagesz(pagesz) != 0) {
+		printf("Usage: bench [-r rounds] [-b batch] [-p pagesz] [filter]\n");
+		return 1;
+	}
+	if (optind < argc)
+		filter = argv[optind];
+
+	printf("%-28s %10s %10s %10s %10s %10s\n", "benchmark (ns/op)",
+		"mean", "p50", "p90", "p99", "max");
+	bench_queue();
+	bench_mlq();
+	bench_mm();
+	bench_tlb();
+	bench_slot();
+	return 0;
+}
@@ -13,6 +13,7 @@
  */
  
 #include "mm.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -67,6 +68,9 @@ int tlb_flush_tlb_of(struct pcb_t *proc, struct memphy_struct *mp)
   /* Flush TLB cached */
   if (proc && proc->tlb)
   {
+#ifdef OS_TRACE
+    trace_instant(TRACE_PID_PROC, proc->pid, "tlb", "flush", "\"entries\":%d", proc->tlb->maxsz);
+#endif
     // Iterate over each TLB entry and invalidate it
     for (int i = 0; i < proc->tlb->maxsz; i++)
     {
@@ -149,18 +153,22 @@ int tlbread(struct pcb_t *proc, uint32_t source, uint32_t offset, uint32_t *dest
   BYTE data;
   uint32_t frame_num = INVALID_FRAME_NUM;
   uint32_t addr = proc->regs[source] + offset;
-  frame_num = tlb_cache_read(proc->tlb, addr);
+  if (tlb_cache_read(proc->tlb, addr, &frame_num) != 0)
+    frame_num = INVALID_FRAME_NUM;
 
 #ifdef IODUMP
-  if (frame_num != INVALID_FRAME_NUM)
-    printf("TLB hit at read region=%d offset=%d\n", source, offset);
-  else
-    printf("TLB miss at read region=%d offset=%d\n", source, offset);
+  if (!iodump_quiet)
+  {
+    if (frame_num != INVALID_FRAME_NUM)
+      printf("TLB hit at read region=%d offset=%d\n", source, offset);
+    else
+      printf("TLB miss at read region=%d offset=%d\n", source, offset);
 
 #ifdef PAGETBL_DUMP
-  print_pgtbl(proc, 0, -1); //print max TBL
+    print_pgtbl_delta(proc);
 #endif
-  MEMPHY_dump(proc->mram);
+    MEMPHY_dump(proc->mram);
+  }
 #endif
 
   int val = __read(proc, 0, source, offset, &data);
@@ -194,18 +202,22 @@ int tlbwrite(struct pcb_t *proc, BYTE data, uint32_t destination, uint32_t offse
 
   uint32_t frame_num = INVALID_FRAME_NUM;
   uint32_t addr = proc->regs[destination] + offset;
-  frame_num = tlb_cache_read(proc->tlb, addr);
+  if (tlb_cache_read(proc->tlb, addr, &frame_num) != 0)
+    frame_num = INVALID_FRAME_NUM;
 
 #ifdef IODUMP
-  if (frame_num != INVALID_FRAME_NUM)
-    printf("TLB hit at write region=%d offset=%d value=%d\n", destination, offset, data);
-  else
-    printf("TLB miss at write region=%d offset=%d value=%d\n", destination, offset, data);
+  if (!iodump_quiet)
+  {
+    if (frame_num != INVALID_FRAME_NUM)
+      printf("TLB hit at write region=%d offset=%d value=%d\n", destination, offset, data);
+    else
+      printf("TLB miss at write region=%d offset=%d value=%d\n", destination, offset, data);
 
 #ifdef PAGETBL_DUMP
-  print_pgtbl(proc, 0, -1); // print max TBL
+    print_pgtbl_delta(proc);
 #endif
-  MEMPHY_dump(proc->mram);
+    MEMPHY_dump(proc->mram);
+  }
 #endif
 
   int val = __write(proc, 0, destination, offset, data);
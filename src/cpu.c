@@ -2,6 +2,8 @@
 #include "cpu.h"
 #include "mem.h"
 #include "mm.h"
+#include <stdlib.h>
+#include <string.h>
 
 int calc(struct pcb_t * proc) {
 	return ((unsigned long)proc & 0UL);
@@ -45,60 +47,232 @@ int write(
 	return write_mem(proc->regs[destination] + offset, proc, data);
 } 
 
-int run(struct pcb_t * proc) {
-	/* Check if Program Counter point to the proper instruction */
-	if (proc->pc >= proc->code->size) {
-		return 1;
+int copy(
+		struct pcb_t * proc, // Process executing the instruction
+		uint32_t source, // Index of source register
+		uint32_t destination, // Index of destination register
+		uint32_t size) { // Number of bytes
+	uint32_t i;
+	BYTE data;
+	for (i = 0; i < size; i++) {
+		if (read_mem(proc->regs[source] + i, proc, &data) ||
+		    write_mem(proc->regs[destination] + i, proc, data)) {
+			return 1;
+		}
 	}
-	
-	struct inst_t ins = proc->code->text[proc->pc];
-	proc->pc++;
-	int stat = 1;
-	switch (ins.opcode) {
-	case CALC:
-		stat = calc(proc);
-		break;
-	case ALLOC:
-#ifdef CPU_TLB 
-		stat = tlballoc(proc, ins.arg_0, ins.arg_1);
-#elif defined(MM_PAGING)
-		stat = pgalloc(proc, ins.arg_0, ins.arg_1);
-#else
-		stat = alloc(proc, ins.arg_0, ins.arg_1);
+	return 0;
+}
+
+int fill(
+		struct pcb_t * proc, // Process executing the instruction
+		BYTE data, // Value set to every byte
+		uint32_t destination, // Index of destination register
+		uint32_t size) { // Number of bytes
+	uint32_t i;
+	for (i = 0; i < size; i++) {
+		if (write_mem(proc->regs[destination] + i, proc, data)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int cmp(
+		struct pcb_t * proc, // Process executing the instruction
+		uint32_t source, // Index of first register
+		uint32_t destination, // Index of second register
+		uint32_t size) { // Number of bytes
+	uint32_t i;
+	BYTE a, b;
+	for (i = 0; i < size; i++) {
+		if (read_mem(proc->regs[source] + i, proc, &a) ||
+		    read_mem(proc->regs[destination] + i, proc, &b)) {
+			return 1;
+		}
+		if (a != b) {
+			break;
+		}
+	}
+	/* Result in the compare register, bytes compare unsigned as memcmp */
+	proc->cr = (i < size) ?
+		((unsigned char)a > (unsigned char)b) - ((unsigned char)a < (unsigned char)b) : 0;
+	return 0;
+}
+
+/* Instruction handlers, one set per memory backend */
+static int ins_calc(struct pcb_t * proc, const struct inst_t * ins) {
+	return calc(proc);
+}
+
+static int ins_invalid(struct pcb_t * proc, const struct inst_t * ins) {
+	return 1;
+}
+
+/* Legacy segmentation, see mem.c */
+static int ins_alloc(struct pcb_t * proc, const struct inst_t * ins) {
+	return alloc(proc, ins->arg_0, ins->arg_1);
+}
+
+static int ins_free(struct pcb_t * proc, const struct inst_t * ins) {
+	return free_data(proc, ins->arg_0);
+}
+
+static int ins_read(struct pcb_t * proc, const struct inst_t * ins) {
+	return read(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int ins_write(struct pcb_t * proc, const struct inst_t * ins) {
+	return write(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int ins_copy(struct pcb_t * proc, const struct inst_t * ins) {
+	return copy(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int ins_fill(struct pcb_t * proc, const struct inst_t * ins) {
+	return fill(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int ins_cmp(struct pcb_t * proc, const struct inst_t * ins) {
+	return cmp(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+#ifdef MM_PAGING
+/* Paging */
+static int ins_pgalloc(struct pcb_t * proc, const struct inst_t * ins) {
+	return pgalloc(proc, ins->arg_0, ins->arg_1);
+}
+
+static int ins_pgfree(struct pcb_t * proc, const struct inst_t * ins) {
+	return pgfree_data(proc, ins->arg_0);
+}
+
+static int ins_pgread(struct pcb_t * proc, const struct inst_t * ins) {
+	return pgread(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int ins_pgwrite(struct pcb_t * proc, const struct inst_t * ins) {
+	return pgwrite(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+/* Block instructions, the TLB backend shares them since its cache
+ * only holds frame numbers */
+static int ins_pgcopy(struct pcb_t * proc, const struct inst_t * ins) {
+	return pgcopy(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int ins_pgfill(struct pcb_t * proc, const struct inst_t * ins) {
+	return pgfill(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
+
+static int ins_pgcmp(struct pcb_t * proc, const struct inst_t * ins) {
+	return pgcmp(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
 #endif
-		break;
-	case FREE:
+
 #ifdef CPU_TLB
-		stat = tlbfree_data(proc, ins.arg_0);
-#elif defined(MM_PAGING)
-		stat = pgfree_data(proc, ins.arg_0);
-#else
-		stat = free_data(proc, ins.arg_0);
+/* Paging behind the CPU TLB */
+static int ins_tlballoc(struct pcb_t * proc, const struct inst_t * ins) {
+	return tlballoc(proc, ins->arg_0, ins->arg_1);
+}
+
+static int ins_tlbfree(struct pcb_t * proc, const struct inst_t * ins) {
+	return tlbfree_data(proc, ins->arg_0);
+}
+
+static int ins_tlbread(struct pcb_t * proc, const struct inst_t * ins) {
+	uint32_t data;
+	return tlbread(proc, ins->arg_0, ins->arg_1, &data);
+}
+
+static int ins_tlbwrite(struct pcb_t * proc, const struct inst_t * ins) {
+	return tlbwrite(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+}
 #endif
-		break;
-	case READ:
+
+/* Built in backends, the most capable first */
+static const struct mem_backend_t mem_backends[] = {
 #ifdef CPU_TLB
-		stat = tlbread(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#elif defined(MM_PAGING)
-		stat = pgread(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	{ "tlb", 1, ins_tlballoc, ins_tlbfree, ins_tlbread, ins_tlbwrite,
+	  ins_pgcopy, ins_pgfill, ins_pgcmp },
 #endif
-		break;
-	case WRITE:
-#ifdef CPU_TLB
-		stat = tlbwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#elif defined(MM_PAGING)
-		stat = pgwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+#ifdef MM_PAGING
+	{ "paging", 1, ins_pgalloc, ins_pgfree, ins_pgread, ins_pgwrite,
+	  ins_pgcopy, ins_pgfill, ins_pgcmp },
 #endif
-		break;
-	default:
-		stat = 1;
+	{ "legacy", 0, ins_alloc, ins_free, ins_read, ins_write,
+	  ins_copy, ins_fill, ins_cmp },
+};
+
+#define NR_MEM_BACKENDS (sizeof(mem_backends) / sizeof(mem_backends[0]))
+
+static const struct mem_backend_t * mem_backend = &mem_backends[0];
+
+const struct mem_backend_t * cpu_find_backend(const char * name) {
+	unsigned int i;
+	for (i = 0; i < NR_MEM_BACKENDS; i++)
+		if (!strcmp(mem_backends[i].name, name))
+			return &mem_backends[i];
+	return NULL;
+}
+
+const struct mem_backend_t * cpu_default_backend(int paging) {
+	unsigned int i;
+	for (i = 0; i < NR_MEM_BACKENDS; i++)
+		if (mem_backends[i].paging == paging)
+			return &mem_backends[i];
+	return &mem_backends[NR_MEM_BACKENDS - 1];
+}
+
+void cpu_set_backend(const struct mem_backend_t * backend) {
+	mem_backend = backend;
+}
+
+const struct mem_backend_t * cpu_backend(void) {
+	return mem_backend;
+}
+
+/* Handler of an opcode in the selected backend */
+static ins_handler_t ins_handler(enum ins_opcode_t op) {
+	switch (op) {
+	case CALC:	return ins_calc;
+	case ALLOC:	return mem_backend->alloc;
+	case FREE:	return mem_backend->free;
+	case READ:	return mem_backend->read;
+	case WRITE:	return mem_backend->write;
+	case COPY:	return mem_backend->copy;
+	case FILL:	return mem_backend->fill;
+	case CMP:	return mem_backend->cmp;
+	default:	return ins_invalid;
 	}
-	return stat;
+}
 
+void cpu_decode(struct code_seg_t * code) {
+	uint32_t i;
+	code->handler = (ins_handler_t *)malloc(
+		sizeof(ins_handler_t) * code->size
+	);
+	for (i = 0; i < code->size; i++)
+		code->handler[i] = ins_handler(code->text[i].opcode);
 }
 
+int run_burst(struct pcb_t * proc, int n) {
+	struct code_seg_t * code = proc->code;
+	int executed = 0;
+	while (executed < n && proc->pc < code->size) {
+		uint32_t pc = proc->pc++;
+		code->handler[pc](proc, &code->text[pc]);
+		executed++;
+	}
+	return executed;
+}
 
+int run(struct pcb_t * proc) {
+	/* Check if Program Counter point to the proper instruction */
+	if (proc->pc >= proc->code->size) {
+		return 1;
+	}
+	
+	uint32_t pc = proc->pc++;
+	return proc->code->handler[pc](proc, &proc->code->text[pc]);
+}
@@ -1,37 +1,102 @@
 
 #include "loader.h"
+#include "cpu.h"
+#include "prog.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 static uint32_t avail_pid = 1;
 
-#define OPT_CALC	"calc"
-#define OPT_ALLOC	"alloc"
-#define OPT_FREE	"free"
-#define OPT_READ	"read"
-#define OPT_WRITE	"write"
+/* Code segments already loaded, shared by processes running the same
+ * program. The cache holds one reference on each segment, a segment
+ * is replaced when its file is modified. */
+struct code_cache_t {
+	char * path;
+	struct timespec mtime;
+	uint32_t priority;
+	struct code_seg_t * code;
+	struct code_cache_t * next;
+};
 
-static enum ins_opcode_t get_opcode(char * opt) {
-	if (!strcmp(opt, OPT_CALC)) {
-		return CALC;
-	}else if (!strcmp(opt, OPT_ALLOC)) {
-		return ALLOC;
-	}else if (!strcmp(opt, OPT_FREE)) {
-		return FREE;
-	}else if (!strcmp(opt, OPT_READ)) {
-		return READ;
-	}else if (!strcmp(opt, OPT_WRITE)) {
-		return WRITE;
-	}else{
-		printf("Opcode: %s\n", opt);
-		exit(1);
+static struct code_cache_t * code_cache = NULL;
+static pthread_mutex_t code_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void code_put(struct code_seg_t * code) {
+	int last;
+	pthread_mutex_lock(&code_lock);
+	last = (--code->refcnt == 0);
+	pthread_mutex_unlock(&code_lock);
+	if (last) {
+		free(code->handler);
+		prog_release(code);
 	}
 }
 
+static struct code_seg_t * code_get(const char * path, uint32_t * priority) {
+	struct code_cache_t ** it, * ent = NULL;
+	struct code_seg_t * code;
+	struct stat st;
+
+	if (stat(path, &st) != 0) {
+		printf("Cannot find process description at '%s'\n", path);
+		exit(1);		
+	}
+
+	pthread_mutex_lock(&code_lock);
+	for (it = &code_cache; *it != NULL; it = &(*it)->next) {
+		if (!strcmp((*it)->path, path)) {
+			ent = *it;
+			break;
+		}
+	}
+	if (ent != NULL &&
+	    ent->mtime.tv_sec == st.st_mtim.tv_sec &&
+	    ent->mtime.tv_nsec == st.st_mtim.tv_nsec) {
+		/* Cache hit, share the segment */
+		ent->code->refcnt++;
+		*priority = ent->priority;
+		code = ent->code;
+		pthread_mutex_unlock(&code_lock);
+		return code;
+	}
+	pthread_mutex_unlock(&code_lock);
+
+	/* Read process code from file, compiled or text */
+	code = prog_load(path, priority);
+	if (code == NULL) {
+		printf("Cannot find process description at '%s'\n", path);
+		exit(1);		
+	}
+	cpu_decode(code);
+
+	pthread_mutex_lock(&code_lock);
+	if (ent == NULL) {
+		ent = (struct code_cache_t*)malloc(sizeof(struct code_cache_t));
+		ent->path = strdup(path);
+		ent->next = code_cache;
+		code_cache = ent;
+	} else {
+		/* Stale segment, drop the cache reference */
+		if (--ent->code->refcnt == 0) {
+			free(ent->code->handler);
+			prog_release(ent->code);
+		}
+	}
+	ent->mtime = st.st_mtim;
+	ent->priority = *priority;
+	ent->code = code;
+	code->refcnt++; /* Reference of the cache */
+	pthread_mutex_unlock(&code_lock);
+
+	return code;
+}
+
 struct pcb_t * load(const char * path) {
 	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
+	struct pcb_t * proc = (struct pcb_t * )calloc(1, sizeof(struct pcb_t));
 	proc->pid = avail_pid;
 	avail_pid++;
 	proc->page_table =
@@ -39,53 +104,6 @@ struct pcb_t * load(const char * path) {
 	proc->bp = PAGE_SIZE;
 	proc->pc = 0;
 
-	/* Read process code from file */
-	FILE * file;
-	if ((file = fopen(path, "r")) == NULL) {
-		printf("Cannot find process description at '%s'\n", path);
-		exit(1);		
-	}
-	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
-	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
-	);
-	uint32_t i = 0;
-	for (i = 0; i < proc->code->size; i++) {
-		fscanf(file, "%s", opcode);
-		proc->code->text[i].opcode = get_opcode(opcode);
-		switch(proc->code->text[i].opcode) {
-		case CALC:
-			break;
-		case ALLOC:
-			fscanf(
-				file,
-				"%u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
-			);
-			break;
-		case FREE:
-			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
-			break;
-		case READ:
-		case WRITE:
-			fscanf(
-				file,
-				"%u %u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1,
-				&proc->code->text[i].arg_2
-			);
-			break;	
-		default:
-			printf("Opcode: %s\n", opcode);
-			exit(1);
-		}
-	}
+	proc->code = code_get(path, &proc->priority);
 	return proc;
 }
-
-
-
@@ -0,0 +1,143 @@
+
+#include "lockprof.h"
+#include <time.h>
+
+/* Locks held by the calling thread, to charge the hold time of an
+ * unlock to the site which acquired it */
+#define LOCKPROF_MAX_HELD	8
+
+struct lockprof_held {
+	pthread_mutex_t * m;
+	struct lockprof_site * site;
+	uint64_t since;
+};
+
+static __thread struct lockprof_held held[LOCKPROF_MAX_HELD];
+static __thread int nr_held = 0;
+
+static struct lockprof_site * sites = NULL;
+static pthread_mutex_t sites_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t lockprof_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void lockprof_max(uint64_t * max, uint64_t v) {
+	uint64_t cur = __atomic_load_n(max, __ATOMIC_RELAXED);
+	while (v > cur && !__atomic_compare_exchange_n(max, &cur, v, 0,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+/*lockprof_lock - acquire a mutex and account for it
+ *@m: mutex
+ *@site: statistics of the call site
+ */
+void lockprof_lock(pthread_mutex_t * m, struct lockprof_site * site) {
+	uint64_t wait = 0, now;
+
+	if (pthread_mutex_trylock(m) != 0) {
+		/* Contended, time the wait */
+		uint64_t start = lockprof_now();
+		pthread_mutex_lock(m);
+		wait = lockprof_now() - start;
+	}
+	now = lockprof_now();
+
+	if (!__atomic_load_n(&site->registered, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_lock(&sites_lock);
+		if (!site->registered) {
+			site->next = sites;
+			sites = site;
+			__atomic_store_n(&site->registered, 1, __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&sites_lock);
+	}
+
+	__atomic_add_fetch(&site->nr_acq, 1, __ATOMIC_RELAXED);
+	if (wait > 0) {
+		int bucket = 63 - __builtin_clzll(wait);
+		if (bucket >= LOCKPROF_NR_BUCKETS)
+			bucket = LOCKPROF_NR_BUCKETS - 1;
+		__atomic_add_fetch(&site->nr_contended, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&site->wait_ns, wait, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&site->hist[bucket], 1, __ATOMIC_RELAXED);
+		lockprof_max(&site->max_wait_ns, wait);
+	}
+
+	if (nr_held < LOCKPROF_MAX_HELD) {
+		held[nr_held].m = m;
+		held[nr_held].site = site;
+		held[nr_held].since = now;
+		nr_held++;
+	}
+}
+
+/*lockprof_unlock - release a mutex taken by lockprof_lock
+ *@m: mutex
+ */
+void lockprof_unlock(pthread_mutex_t * m) {
+	int it;
+
+	for (it = nr_held - 1; it >= 0; it--) {
+		if (held[it].m != m)
+			continue;
+		uint64_t hold = lockprof_now() - held[it].since;
+		__atomic_add_fetch(&held[it].site->hold_ns, hold, __ATOMIC_RELAXED);
+		lockprof_max(&held[it].site->max_hold_ns, hold);
+		for (; it < nr_held - 1; it++)
+			held[it] = held[it + 1];
+		nr_held--;
+		break;
+	}
+	pthread_mutex_unlock(m);
+}
+
+/*lockprof_dump - print the statistics of every call site
+ *@out: output stream
+ *
+ * Sites are printed by decreasing total wait time, each contended one
+ * is followed by its wait time histogram.
+ */
+void lockprof_dump(FILE * out) {
+	struct lockprof_site * it, * sorted = NULL, ** pos;
+	int k;
+
+	pthread_mutex_lock(&sites_lock);
+	while ((it = sites) != NULL) {
+		sites = it->next;
+		for (pos = &sorted; *pos != NULL && (*pos)->wait_ns >= it->wait_ns;
+		     pos = &(*pos)->next)
+			;
+		it->next = *pos;
+		*pos = it;
+	}
+	sites = sorted;
+
+	fprintf(out, "LOCKPROF %-40s %10s %10s %10s %10s %10s %10s\n",
+		"site", "acq", "contended", "wait_us", "maxwait_us", "hold_us",
+		"maxhold_us");
+	for (it = sites; it != NULL; it = it->next) {
+		char name[128];
+		snprintf(name, sizeof(name), "%s %s:%d", it->lock + (it->lock[0] == '&'),
+			it->file, it->line);
+		fprintf(out, "LOCKPROF %-40s %10lu %10lu %10lu %10lu %10lu %10lu\n",
+			name, (unsigned long)it->nr_acq,
+			(unsigned long)it->nr_contended,
+			(unsigned long)(it->wait_ns / 1000),
+			(unsigned long)(it->max_wait_ns / 1000),
+			(unsigned long)(it->hold_ns / 1000),
+			(unsigned long)(it->max_hold_ns / 1000));
+		if (it->nr_contended == 0)
+			continue;
+		fprintf(out, "LOCKPROF   wait ns:");
+		for (k = 0; k < LOCKPROF_NR_BUCKETS; k++)
+			if (it->hist[k])
+				fprintf(out, " <%lu:%lu", 2UL << k,
+					(unsigned long)it->hist[k]);
+		fprintf(out, "\n");
+	}
+	pthread_mutex_unlock(&sites_lock);
+}
@@ -0,0 +1,105 @@
+/*
+ * Offline printer for the MEMPHY binary dump
+ *
+ *   memdump [file] [seq]
+ *
+ * Without seq every record is printed in the order it was dumped.
+ * With seq the frames are replayed up to that MEMPHY_dump call and
+ * the resulting RAM content is printed like the former RAM_status.txt.
+ */
+
+#include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct frame_img {
+   uint32_t fpn;
+   BYTE *data;
+   struct frame_img *next;
+};
+
+static void print_frame(uint32_t fpn, BYTE *data, uint32_t pagesz)
+{
+  uint32_t off;
+
+  printf("\t\t Frame %08x\n", fpn);
+  for (off = 0; off < pagesz; ++off)
+  {
+    if (off % 32 == 0)
+      printf("\n");
+    printf("%d ", data[off]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+  const char *path = (argc > 1) ? argv[1] : MEMPHY_DUMP_FILE;
+  long upto = (argc > 2) ? atol(argv[2]) : -1;
+  struct memphy_dump_hdr hdr;
+  struct memphy_dump_rec rec;
+  struct frame_img *imgs = NULL, *img;
+  uint32_t lastseq = 0;
+  BYTE *data;
+  FILE *f;
+
+  f = fopen(path, "rb");
+  if (f == NULL)
+  {
+    perror(path);
+    return 1;
+  }
+
+  if (fread(&hdr, sizeof(hdr), 1, f) != 1 || hdr.magic != MEMPHY_DUMP_MAGIC)
+  {
+    fprintf(stderr, "%s: not a MEMPHY dump\n", path);
+    fclose(f);
+    return 1;
+  }
+
+  data = malloc(hdr.pagesz);
+  while (fread(&rec, sizeof(rec), 1, f) == 1 &&
+         fread(data, hdr.pagesz, 1, f) == 1)
+  {
+    if (upto < 0)
+    {
+      if (rec.seq != lastseq)
+        printf("Dump %u\n", rec.seq);
+      lastseq = rec.seq;
+      print_frame(rec.fpn, data, hdr.pagesz);
+      continue;
+    }
+
+    if (rec.seq > upto)
+      break;
+
+    /* Keep the latest image of each frame, sorted by frame number */
+    struct frame_img **it = &imgs;
+    while (*it != NULL && (*it)->fpn < rec.fpn)
+      it = &(*it)->next;
+
+    if (*it == NULL || (*it)->fpn != rec.fpn)
+    {
+      img = malloc(sizeof(struct frame_img));
+      img->fpn = rec.fpn;
+      img->data = malloc(hdr.pagesz);
+      img->next = *it;
+      *it = img;
+    }
+    memcpy((*it)->data, data, hdr.pagesz);
+  }
+
+  while (imgs != NULL)
+  {
+    img = imgs;
+    print_frame(img->fpn, img->data, hdr.pagesz);
+    imgs = img->next;
+    free(img->data);
+    free(img);
+  }
+
+  free(data);
+  fclose(f);
+  return 0;
+}
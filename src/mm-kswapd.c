@@ -0,0 +1,223 @@
+//#ifdef MM_KSWAPD
+/*
+ * PAGING based Memory Management
+ * Background page reclaim daemon mm/mm-kswapd.c
+ *
+ * kswapd wakes up every time slot and, whenever the free frames of
+ * MEMRAM drop below the low watermark, evicts the oldest online pages
+ * of the registered processes to MEMSWP until the high watermark is
+ * reached. The fault path then finds a free frame and rarely has to
+ * evict a victim synchronously.
+ *
+ * The list of reclaimable processes is kept with or without the daemon,
+ * the fault path takes a frame from another process through it when the
+ * faulting one has no online page left.
+ */
+
+#include "mm.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+struct kswapd_node {
+   struct pcb_t *proc;
+   struct kswapd_node *prev, *next;
+};
+
+static struct kswapd_node *kswapd_list = NULL;
+static int kswapd_nr = 0;
+static pthread_mutex_t kswapd_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  kswapd_register - make the pages of a process reclaimable
+ *  @proc: process with an initialized mm
+ */
+int kswapd_register(struct pcb_t *proc)
+{
+  struct kswapd_node *node = malloc(sizeof(struct kswapd_node));
+
+  node->proc = proc;
+  node->prev = NULL;
+  proc->mm->kswapd = node;
+
+  pthread_mutex_lock(&kswapd_lock);
+  node->next = kswapd_list;
+  if (kswapd_list != NULL)
+    kswapd_list->prev = node;
+  kswapd_list = node;
+  kswapd_nr++;
+  pthread_mutex_unlock(&kswapd_lock);
+
+  return 0;
+}
+
+/*
+ *  kswapd_unregister - stop reclaiming from a process
+ *  @proc: process going to be released
+ *
+ *  Waits for an in-progress reclaim pass, so the caller is safe
+ *  to free the process afterwards.
+ */
+int kswapd_unregister(struct pcb_t *proc)
+{
+  struct kswapd_node *node = proc->mm->kswapd;
+
+  if (node == NULL)
+    return -1;
+
+  pthread_mutex_lock(&kswapd_lock);
+  if (node->prev != NULL)
+    node->prev->next = node->next;
+  else
+    kswapd_list = node->next;
+  if (node->next != NULL)
+    node->next->prev = node->prev;
+  kswapd_nr--;
+  pthread_mutex_unlock(&kswapd_lock);
+
+  proc->mm->kswapd = NULL;
+  free(node);
+  return 0;
+}
+
+/*
+ *  kswapd_nr_proc - number of processes currently registered
+ */
+int kswapd_nr_proc(void)
+{
+  int nr;
+
+  pthread_mutex_lock(&kswapd_lock);
+  nr = kswapd_nr;
+  pthread_mutex_unlock(&kswapd_lock);
+
+  return nr;
+}
+
+/*
+ *  kswapd_evict_one - evict the oldest online page of a process
+ *  @proc: victim process, its mm lock is held
+ *  @retfpn: return the released MEMRAM frame, -1 when zswap kept it
+ */
+static int kswapd_evict_one(struct pcb_t *proc, int *retfpn)
+{
+  int vicpgn;
+
+  if (find_victim_page(proc, proc->mm, &vicpgn) == 0 ||
+      pg_swapout(proc, vicpgn, retfpn) < 0)
+    return -1;
+
+  return 0;
+}
+
+/*
+ *  kswapd_reclaim_one - evict the oldest online page of a process
+ *  @proc: victim process
+ *
+ *  A process busy in its own page table is skipped rather than waited on.
+ */
+static int kswapd_reclaim_one(struct pcb_t *proc)
+{
+  struct mm_struct *mm = proc->mm;
+  int vicfpn;
+
+  if (pthread_mutex_trylock(&mm->lock) != 0)
+    return -1;
+
+  if (kswapd_evict_one(proc, &vicfpn) < 0)
+  {
+    pthread_mutex_unlock(&mm->lock);
+    return -1;
+  }
+  pthread_mutex_unlock(&mm->lock);
+
+  /* zswap may keep the frame to grow its pool */
+  if (vicfpn >= 0)
+    MEMPHY_put_freefp(proc->mram, vicfpn);
+
+  return 0;
+}
+
+/*
+ *  kswapd_steal_frame - take a MEMRAM frame from another process
+ *  @caller: faulting process, its mm lock is held
+ *  @retfpn: return the frame released by the victim
+ *
+ *  Used by the fault path when MEMRAM has no free frame and the caller
+ *  has no online page of its own to evict. Processes busy in their own
+ *  page table are skipped. Return 0 on success, -1 if no frame was found.
+ */
+int kswapd_steal_frame(struct pcb_t *caller, int *retfpn)
+{
+  struct kswapd_node *it;
+  int ret = -1;
+
+  pthread_mutex_lock(&kswapd_lock);
+  for (it = kswapd_list; it != NULL && ret < 0; it = it->next)
+  {
+    struct mm_struct *mm = it->proc->mm;
+
+    if (it->proc == caller || pthread_mutex_trylock(&mm->lock) != 0)
+      continue;
+
+    while (kswapd_evict_one(it->proc, retfpn) == 0)
+      if (*retfpn >= 0)
+      {
+        ret = 0;
+        break;
+      }
+    pthread_mutex_unlock(&mm->lock);
+  }
+  pthread_mutex_unlock(&kswapd_lock);
+
+  return ret;
+}
+
+/*
+ *  kswapd_balance - refill MEMRAM free frames up to the high watermark
+ *  @mram: the shared MEMRAM device
+ *
+ *  Return the number of reclaimed frames.
+ */
+int kswapd_balance(struct memphy_struct *mram)
+{
+  int numfp = mram->maxsz / PAGING_PAGESZ;
+  int lowmark = PAGING_WMARK(numfp, PAGING_WMARK_LOW_PCT);
+  int highmark = PAGING_WMARK(numfp, PAGING_WMARK_HIGH_PCT);
+  int nr_reclaimed = 0;
+
+  if (mram->free_fp_cnt >= lowmark)
+    return 0;
+
+  pthread_mutex_lock(&kswapd_lock);
+  while (mram->free_fp_cnt < highmark && nr_reclaimed < PAGING_KSWAPD_BATCH)
+  {
+    struct kswapd_node *it;
+    int progress = 0;
+
+    /* Round robin over processes, one page each per pass */
+    for (it = kswapd_list; it != NULL; it = it->next)
+    {
+      if (mram->free_fp_cnt >= highmark || nr_reclaimed >= PAGING_KSWAPD_BATCH)
+        break;
+
+      if (kswapd_reclaim_one(it->proc) == 0)
+      {
+        nr_reclaimed++;
+        progress = 1;
+      }
+    }
+
+    if (!progress)
+      break;
+  }
+  pthread_mutex_unlock(&kswapd_lock);
+
+#ifdef MMDBG
+  if (nr_reclaimed > 0)
+    printf("kswapd: reclaimed %d frames, free %d\n", nr_reclaimed, mram->free_fp_cnt);
+#endif
+
+  return nr_reclaimed;
+}
+
+//#endif
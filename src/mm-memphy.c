@@ -5,28 +5,73 @@
  */
 
 #include "mm.h"
+#include "lockprof.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 pthread_mutex_t lock_mem;
 
 FILE *file;
 
+static FILE *dump_file = NULL;
+static uint32_t dump_seq = 0;
+
 /*
- *  MEMPHY_mv_csr - move MEMPHY cursor
+ *  MEMPHY_mark_dirty - record a frame changed since the last dump
  *  @mp: memphy struct
- *  @offset: offset
+ *  @fpn: changed frame
+ *
+ *  Caller holds lock_mem.
  */
-int MEMPHY_mv_csr(struct memphy_struct *mp, int offset)
+static void memphy_mark_dirty(struct memphy_struct *mp, int fpn)
 {
-   int numstep = 0;
+   if (mp->dirty_map == NULL || fpn < 0 || fpn >= mp->numfp)
+     return;
 
-   mp->cursor = 0;
-   while(numstep < offset && numstep < mp->maxsz){
-     /* Traverse sequentially */
-     mp->cursor = (mp->cursor + 1) % mp->maxsz;
-     numstep++;
+   if (!(mp->dirty_map[fpn / 32] & BIT(fpn % 32)))
+   {
+     mp->dirty_map[fpn / 32] |= BIT(fpn % 32);
+     mp->dirty_list[mp->nr_dirty++] = fpn;
    }
+}
+
+/*
+ *  memphy_mark_dirty_span - record the frames of a written span
+ *  @mp: memphy struct
+ *  @addr: first address
+ *  @len: number of bytes
+ *
+ *  Caller holds lock_mem.
+ */
+static void memphy_mark_dirty_span(struct memphy_struct *mp, addr_t addr, int len)
+{
+  addr_t it;
+
+  for (it = addr >> PAGING_PAGE_SHIFT; len > 0 && it <= (addr + len - 1) >> PAGING_PAGE_SHIFT; it++)
+    memphy_mark_dirty(mp, it);
+}
+
+int MEMPHY_mark_dirty(struct memphy_struct *mp, int fpn)
+{
+   MUTEX_LOCK(&lock_mem);
+   memphy_mark_dirty(mp, fpn);
+   MUTEX_UNLOCK(&lock_mem);
+   return 0;
+}
+
+/*
+ *  MEMPHY_mv_csr - move MEMPHY cursor
+ *  @mp: memphy struct
+ *  @offset: offset
+ */
+int MEMPHY_mv_csr(struct memphy_struct *mp, addr_t offset)
+{
+   /* Where a step by step traversal from 0 ends, without the walk */
+   mp->cursor = (offset < mp->maxsz) ? offset : 0;
 
    return 0;
 }
@@ -37,7 +82,7 @@ int MEMPHY_mv_csr(struct memphy_struct *mp, int offset)
  *  @addr: address
  *  @value: obtained value
  */
-int MEMPHY_seq_read(struct memphy_struct *mp, int addr, BYTE *value)
+int MEMPHY_seq_read(struct memphy_struct *mp, addr_t addr, BYTE *value)
 {
    if (mp == NULL)
      return -1;
@@ -57,7 +102,7 @@ int MEMPHY_seq_read(struct memphy_struct *mp, int addr, BYTE *value)
  *  @addr: address
  *  @value: obtained value
  */
-int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value)
+int MEMPHY_read(struct memphy_struct * mp, addr_t addr, BYTE *value)
 {
    if (mp == NULL)
      return -1;
@@ -76,7 +121,7 @@ int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value)
  *  @addr: address
  *  @data: written data
  */
-int MEMPHY_seq_write(struct memphy_struct * mp, int addr, BYTE value)
+int MEMPHY_seq_write(struct memphy_struct * mp, addr_t addr, BYTE value)
 {
 
    if (mp == NULL)
@@ -87,6 +132,7 @@ int MEMPHY_seq_write(struct memphy_struct * mp, int addr, BYTE value)
 
    MEMPHY_mv_csr(mp, addr);
    mp->storage[addr] = value;
+   MEMPHY_mark_dirty(mp, addr / PAGING_PAGESZ);
 
    return 0;
 }
@@ -97,119 +143,358 @@ int MEMPHY_seq_write(struct memphy_struct * mp, int addr, BYTE value)
  *  @addr: address
  *  @data: written data
  */
-int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data)
+int MEMPHY_write(struct memphy_struct * mp, addr_t addr, BYTE data)
 {
-  pthread_mutex_lock(&lock_mem);
+  MUTEX_LOCK(&lock_mem);
   if (mp == NULL)
   {
-    pthread_mutex_unlock(&lock_mem);
+    MUTEX_UNLOCK(&lock_mem);
     return -1;
   }
 
   if (mp->rdmflg)
   {
     mp->storage[addr] = data;
-    pthread_mutex_unlock(&lock_mem);
+    memphy_mark_dirty(mp, addr / PAGING_PAGESZ);
+    MUTEX_UNLOCK(&lock_mem);
   }
   else /* Sequential access device */
   {
-    pthread_mutex_unlock(&lock_mem);
+    MUTEX_UNLOCK(&lock_mem);
     return MEMPHY_seq_write(mp, addr, data);
   }
 
    return 0;
 }
 
+/*
+ *  MEMPHY_read_block - read a contiguous span of MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: first address
+ *  @buf: obtained values
+ *  @len: number of bytes
+ */
+int MEMPHY_read_block(struct memphy_struct *mp, addr_t addr, BYTE *buf, int len)
+{
+  int it;
+
+  if (mp == NULL || len < 0 || addr + len > mp->maxsz)
+    return -1;
+
+  if (!mp->rdmflg)
+  { /* Sequential access device */
+    for (it = 0; it < len; it++)
+      MEMPHY_read(mp, addr + it, &buf[it]);
+    return 0;
+  }
+
+  MUTEX_LOCK(&lock_mem);
+  memcpy(buf, mp->storage + addr, len);
+  MUTEX_UNLOCK(&lock_mem);
+
+  return 0;
+}
+
+/*
+ *  MEMPHY_write_block - write a contiguous span of MEMPHY device
+ *  @mp: memphy struct
+ *  @addr: first address
+ *  @buf: written values
+ *  @len: number of bytes
+ */
+int MEMPHY_write_block(struct memphy_struct *mp, addr_t addr, const BYTE *buf, int len)
+{
+  int it;
+
+  if (mp == NULL || len < 0 || addr + len > mp->maxsz)
+    return -1;
+
+  if (!mp->rdmflg)
+  { /* Sequential access device */
+    for (it = 0; it < len; it++)
+      MEMPHY_write(mp, addr + it, buf[it]);
+    return 0;
+  }
+
+  MUTEX_LOCK(&lock_mem);
+  memcpy(mp->storage + addr, buf, len);
+  memphy_mark_dirty_span(mp, addr, len);
+  MUTEX_UNLOCK(&lock_mem);
+
+  return 0;
+}
+
+/*
+ *  MEMPHY_copy_block - copy a span to another place of the device
+ *  @mp: memphy struct
+ *  @dst: first destination address
+ *  @src: first source address
+ *  @len: number of bytes
+ */
+int MEMPHY_copy_block(struct memphy_struct *mp, addr_t dst, addr_t src, int len)
+{
+  int it;
+
+  if (mp == NULL || len < 0 || dst + len > mp->maxsz || src + len > mp->maxsz)
+    return -1;
+
+  if (!mp->rdmflg)
+  { /* Sequential access device */
+    BYTE data;
+    for (it = 0; it < len; it++)
+    {
+      MEMPHY_read(mp, src + it, &data);
+      MEMPHY_write(mp, dst + it, data);
+    }
+    return 0;
+  }
+
+  MUTEX_LOCK(&lock_mem);
+  memmove(mp->storage + dst, mp->storage + src, len);
+  memphy_mark_dirty_span(mp, dst, len);
+  MUTEX_UNLOCK(&lock_mem);
+
+  return 0;
+}
+
+/*
+ *  MEMPHY_set_block - set every byte of a span of the device
+ *  @mp: memphy struct
+ *  @addr: first address
+ *  @value: value of the bytes
+ *  @len: number of bytes
+ */
+int MEMPHY_set_block(struct memphy_struct *mp, addr_t addr, BYTE value, int len)
+{
+  int it;
+
+  if (mp == NULL || len < 0 || addr + len > mp->maxsz)
+    return -1;
+
+  if (!mp->rdmflg)
+  { /* Sequential access device */
+    for (it = 0; it < len; it++)
+      MEMPHY_write(mp, addr + it, value);
+    return 0;
+  }
+
+  MUTEX_LOCK(&lock_mem);
+  memset(mp->storage + addr, value, len);
+  memphy_mark_dirty_span(mp, addr, len);
+  MUTEX_UNLOCK(&lock_mem);
+
+  return 0;
+}
+
+/*
+ *  MEMPHY_cmp_block - compare two spans of the device
+ *  @mp: memphy struct
+ *  @addr0: first address of the first span
+ *  @addr1: first address of the second span
+ *  @len: number of bytes
+ *  @res: return the memcmp result
+ */
+int MEMPHY_cmp_block(struct memphy_struct *mp, addr_t addr0, addr_t addr1, int len, int *res)
+{
+  int it;
+
+  if (mp == NULL || len < 0 || addr0 + len > mp->maxsz || addr1 + len > mp->maxsz)
+    return -1;
+
+  if (!mp->rdmflg)
+  { /* Sequential access device */
+    BYTE a = 0, b = 0;
+    for (it = 0; it < len && a == b; it++)
+    {
+      MEMPHY_read(mp, addr0 + it, &a);
+      MEMPHY_read(mp, addr1 + it, &b);
+    }
+    *res = (unsigned char)a - (unsigned char)b;
+    return 0;
+  }
+
+  MUTEX_LOCK(&lock_mem);
+  *res = memcmp(mp->storage + addr0, mp->storage + addr1, len);
+  MUTEX_UNLOCK(&lock_mem);
+
+  return 0;
+}
+
+/*
+ *  MEMPHY_cp_frames - copy a batch of frames between MEMPHY devices
+ *  @mpsrc: source memphy
+ *  @srcfpn: source frames
+ *  @mpdst: destination memphy
+ *  @dstfpn: destination frames
+ *  @nr: number of frames
+ *
+ *  Random access devices move the whole batch under one lock_mem hold.
+ */
+int MEMPHY_cp_frames(struct memphy_struct *mpsrc, int *srcfpn,
+                     struct memphy_struct *mpdst, int *dstfpn, int nr)
+{
+  int it;
+
+  if (mpsrc == NULL || mpdst == NULL)
+    return -1;
+
+  if (!mpsrc->rdmflg || !mpdst->rdmflg)
+  { /* Sequential access device */
+    for (it = 0; it < nr; it++)
+      __swap_cp_page(mpsrc, srcfpn[it], mpdst, dstfpn[it]);
+    return 0;
+  }
+
+  MUTEX_LOCK(&lock_mem);
+  for (it = 0; it < nr; it++)
+  {
+    memcpy(mpdst->storage + PAGING_FRAME_ADDR(dstfpn[it]),
+           mpsrc->storage + PAGING_FRAME_ADDR(srcfpn[it]), PAGING_PAGESZ);
+    memphy_mark_dirty(mpdst, dstfpn[it]);
+  }
+  MUTEX_UNLOCK(&lock_mem);
+
+  return 0;
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
+ *
+ *  Frames are handed out lazily: the free list only holds released
+ *  frames, never used ones are taken from free_fp_csr upwards.
  */
 int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 {
     /* This setting come with fixed constant PAGESZ */
     int numfp = mp->maxsz / pagesz;
-    struct framephy_struct *newfst, *fst;
-    int iter = 0;
+
+    mp->free_fp_list = NULL;
+    mp->free_fp_csr = 0;
+    mp->numfp = (numfp > 0) ? numfp : 0;
+    mp->free_fp_cnt = mp->numfp;
 
     if (numfp <= 0)
       return -1;
 
-    /* Init head of free framephy list */ 
-    fst = malloc(sizeof(struct framephy_struct));
-    fst->fpn = iter;
-    mp->free_fp_list = fst;
-
-    /* We have list with first element, fill in the rest num-1 element member*/
-    for (iter = 1; iter < numfp ; iter++)
-    {
-       newfst =  malloc(sizeof(struct framephy_struct));
-       newfst->fpn = iter;
-       newfst->fp_next = NULL;
-       fst->fp_next = newfst;
-       fst = newfst;
-    }
-
     return 0;
 }
 
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
 {
-    pthread_mutex_lock(&lock_mem);
+    MUTEX_LOCK(&lock_mem);
     struct framephy_struct *fp = mp->free_fp_list;
 
     if (fp == NULL)
     {
-      pthread_mutex_unlock(&lock_mem);
+      /* Extend into the never used frames */
+      if (mp->free_fp_csr < mp->numfp)
+      {
+        *retfpn = mp->free_fp_csr++;
+        mp->free_fp_cnt--;
+        MUTEX_UNLOCK(&lock_mem);
+        return 0;
+      }
+      MUTEX_UNLOCK(&lock_mem);
       return -1;
     }
 
    *retfpn = fp->fpn;
    mp->free_fp_list = fp->fp_next;
+   mp->free_fp_cnt--;
 
   /* MEMPHY is iteratively used up until its exhausted
    * No garbage collector acting then it not been released
    */
   free(fp);
-  pthread_mutex_unlock(&lock_mem);
+  MUTEX_UNLOCK(&lock_mem);
   return 0;
 }
 
-int MEMPHY_dump(struct memphy_struct * mp)
+/*
+ *  MEMPHY_get_freefp_range - take nr contiguous free frames aligned to nr
+ *  @mp: memphy struct
+ *  @nr: number of frames, a power of 2
+ *  @retfpn: return the first frame of the run
+ *
+ *  Runs are only cut from the never used frames, the frames skipped to
+ *  align the run go to the free list.
+ */
+int MEMPHY_get_freefp_range(struct memphy_struct *mp, int nr, int *retfpn)
 {
-  /*TODO dump memphy contnt mp->storage
-   * for tracing the memory content */
-  pthread_mutex_lock(&lock_mem);
+  int fpn;
+
+  MUTEX_LOCK(&lock_mem);
+  fpn = (mp->free_fp_csr + nr - 1) & ~(nr - 1);
+  if (fpn + nr > mp->numfp)
+  {
+    MUTEX_UNLOCK(&lock_mem);
+    return -1;
+  }
 
-  FILE *file = fopen("RAM_status.txt", "w");
-  if (file == NULL)
+  while (mp->free_fp_csr < fpn)
   {
-    pthread_mutex_unlock(&lock_mem);
-    return -1; // Mở file thất bại
+    struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+
+    newnode->fpn = mp->free_fp_csr++;
+    newnode->fp_next = mp->free_fp_list;
+    mp->free_fp_list = newnode;
   }
+  mp->free_fp_csr += nr;
+  mp->free_fp_cnt -= nr;
+  *retfpn = fpn;
 
-  struct framephy_struct *frameit = mp->used_fp_list;
-  while (frameit != NULL)
+  MUTEX_UNLOCK(&lock_mem);
+  return 0;
+}
+
+/*
+ *  MEMPHY_dump - append the frames changed since the last dump
+ *  @mp: memphy struct
+ *
+ *  Records go to MEMPHY_DUMP_FILE in binary form, one memphy_dump_rec
+ *  header followed by the frame content per changed frame. Use the
+ *  memdump tool to print them.
+ */
+int MEMPHY_dump(struct memphy_struct * mp)
+{
+  int it;
+
+  MUTEX_LOCK(&lock_mem);
+
+  if (dump_file == NULL)
   {
-    fprintf(file, "\t\t Frame %08x\n", frameit->fpn);
-    for (int off = 0; off < PAGING_PAGESZ; ++off)
+    struct memphy_dump_hdr hdr = { MEMPHY_DUMP_MAGIC, PAGING_PAGESZ };
+
+    dump_file = fopen(MEMPHY_DUMP_FILE, "wb");
+    if (dump_file == NULL)
     {
-      if (off % 32 == 0)
-      {
-        fprintf(file, "\n");
-      }
-      fprintf(file, "%d ", mp->storage[frameit->fpn * PAGING_PAGESZ + off]);
+      MUTEX_UNLOCK(&lock_mem);
+      return -1; // Mở file thất bại
     }
-    fprintf(file, "\n");
-    frameit = frameit->fp_next;
+    fwrite(&hdr, sizeof(hdr), 1, dump_file);
+  }
+
+  dump_seq++;
+  for (it = 0; it < mp->nr_dirty; it++)
+  {
+    int fpn = mp->dirty_list[it];
+    struct memphy_dump_rec rec = { dump_seq, fpn };
+
+    fwrite(&rec, sizeof(rec), 1, dump_file);
+    fwrite(mp->storage + PAGING_FRAME_ADDR(fpn), PAGING_PAGESZ, 1, dump_file);
+    mp->dirty_map[fpn / 32] &= ~BIT(fpn % 32);
   }
+  mp->nr_dirty = 0;
+  fflush(dump_file);
 
-  fclose(file);
-  pthread_mutex_unlock(&lock_mem);
+  MUTEX_UNLOCK(&lock_mem);
   return 0;
 }
 
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
 {
+   MUTEX_LOCK(&lock_mem);
    struct framephy_struct *fp = mp->free_fp_list;
    struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
 
@@ -217,14 +502,16 @@ int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
    newnode->fpn = fpn;
    newnode->fp_next = fp;
    mp->free_fp_list = newnode;
+   mp->free_fp_cnt++;
 
+   MUTEX_UNLOCK(&lock_mem);
    return 0;
 }
 
 int MEMPHY_put_usedfp(struct memphy_struct *mp, int fpn)
 {
 
-  pthread_mutex_lock(&lock_mem);
+  MUTEX_LOCK(&lock_mem);
   // struct framephy_struct *fp = (*mp)->used_fp_list;
 
   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
@@ -235,23 +522,27 @@ int MEMPHY_put_usedfp(struct memphy_struct *mp, int fpn)
   newnode->fp_next = mp->used_fp_list;
   mp->used_fp_list = newnode;
 
-  pthread_mutex_unlock(&lock_mem);
+  MUTEX_UNLOCK(&lock_mem);
 
   return 0;
 }
 
 /*
- *  Init MEMPHY struct
+ *  memphy_setup - init MEMPHY fields around an allocated storage
  */
-int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
+static int memphy_setup(struct memphy_struct *mp, addr_t max_size, int randomflg)
 {
-   mp->storage = (BYTE *)malloc(max_size*sizeof(BYTE));
    mp->maxsz = max_size;
 
   mp->used_fp_list = NULL;
 
   MEMPHY_format(mp, PAGING_PAGESZ);
 
+  /* Dirty frame tracking for MEMPHY_dump, zero pages until touched */
+  mp->dirty_map = calloc(DIV_ROUND_UP(mp->numfp, 32) + 1, sizeof(uint32_t));
+  mp->dirty_list = calloc(mp->numfp + 1, sizeof(int));
+  mp->nr_dirty = 0;
+
    mp->rdmflg = (randomflg != 0)?1:0;
 
    if (!mp->rdmflg )   /* Not Ramdom acess device, then it serial device*/
@@ -260,4 +551,61 @@ int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
    return 0;
 }
 
+/*
+ *  Init MEMPHY struct
+ *
+ *  Storage is an anonymous mapping: pages are zero-filled on first touch,
+ *  so the init cost does not depend on the device size.
+ */
+int init_memphy(struct memphy_struct *mp, addr_t max_size, int randomflg)
+{
+   mp->storage = MAP_FAILED;
+   if (max_size > 0)
+      mp->storage = (BYTE *)mmap(NULL, max_size, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+   if (mp->storage != MAP_FAILED)
+      mp->backing = MEMPHY_BACKING_ANON;
+   else
+   {
+      mp->storage = (BYTE *)calloc(max_size, sizeof(BYTE));
+      mp->backing = MEMPHY_BACKING_HEAP;
+   }
+
+   return memphy_setup(mp, max_size, randomflg);
+}
+
+/*
+ *  Init MEMPHY struct backed by a sparse file mapped in memory
+ *  @path: backing file, created or truncated
+ *
+ *  Untouched frames cost neither RSS nor disk blocks, and the file keeps
+ *  the device content after the simulation exits. Falls back to heap
+ *  storage when the file cannot be mapped.
+ */
+int init_memphy_file(struct memphy_struct *mp, addr_t max_size, int randomflg, const char *path)
+{
+   int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+   if (fd < 0 || ftruncate(fd, max_size) < 0)
+   {
+      printf("Cannot create MEMPHY backing file at %s\n", path);
+      if (fd >= 0)
+         close(fd);
+      return init_memphy(mp, max_size, randomflg);
+   }
+
+   mp->storage = (BYTE *)mmap(NULL, max_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+   close(fd); /* The mapping keeps the file */
+
+   if (mp->storage == MAP_FAILED)
+   {
+      printf("Cannot map MEMPHY backing file at %s\n", path);
+      return init_memphy(mp, max_size, randomflg);
+   }
+   mp->backing = MEMPHY_BACKING_FILE;
+
+   return memphy_setup(mp, max_size, randomflg);
+}
+
 //#endif
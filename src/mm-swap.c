@@ -0,0 +1,133 @@
+//#ifdef MM_PAGING
+/*
+ * PAGING based Memory Management
+ * Swap manager mm/mm-swap.c
+ *
+ * Spreads swap slots over every configured MEMSWP device. The swap type
+ * stored in a swapped PTE is the index of the device holding the page.
+ *
+ * Default policy stripes slots round robin over the devices. With
+ * MM_SWP_TIERED the device index is a priority, MEMSWP0 being the
+ * fastest: cold pages are placed on the slowest tier with room while
+ * pages which already came back from swap once (hot) are promoted to
+ * the fastest tier with room on their next swap-out.
+ */
+
+#include "mm.h"
+#include <stdlib.h>
+#include <stdio.h>
+
+static struct {
+   struct memphy_struct *dev[PAGING_MAX_MMSWP];
+   int nr_dev;
+   int cursor;
+
+   unsigned long nr_out[PAGING_MAX_MMSWP];
+   unsigned long nr_in[PAGING_MAX_MMSWP];
+} swp;
+
+static pthread_mutex_t swp_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  swap_dev - get the MEMSWP device of a swap type
+ *  @swptyp: swap type from a PTE
+ */
+struct memphy_struct *swap_dev(int swptyp)
+{
+  if (swptyp < 0 || swptyp >= swp.nr_dev)
+    return NULL;
+
+  return swp.dev[swptyp];
+}
+
+/*
+ *  swap_get_freefp - allocate a swap slot
+ *  @hot: page has been swapped in before
+ *  @swptyp: return the swap type (device index)
+ *  @fpn: return the frame in that device
+ */
+int swap_get_freefp(int hot, int *swptyp, int *fpn)
+{
+  int it, typ;
+
+  pthread_mutex_lock(&swp_lock);
+  for (it = 0; it < swp.nr_dev; it++)
+  {
+#ifdef MM_SWP_TIERED
+    typ = hot ? it : swp.nr_dev - 1 - it;
+#else
+    typ = (swp.cursor + it) % swp.nr_dev;
+#endif
+    if (MEMPHY_get_freefp(swp.dev[typ], fpn) == 0)
+    {
+      swp.cursor = (typ + 1) % swp.nr_dev;
+      swp.nr_out[typ]++;
+      pthread_mutex_unlock(&swp_lock);
+
+      *swptyp = typ;
+      return 0;
+    }
+  }
+  pthread_mutex_unlock(&swp_lock);
+
+  return -1;
+}
+
+/*
+ *  swap_put_freefp - release a swap slot after swap-in
+ *  @swptyp: swap type (device index)
+ *  @fpn: frame in that device
+ */
+int swap_put_freefp(int swptyp, int fpn)
+{
+  struct memphy_struct *mp = swap_dev(swptyp);
+
+  if (mp == NULL)
+    return -1;
+
+  pthread_mutex_lock(&swp_lock);
+  swp.nr_in[swptyp]++;
+  pthread_mutex_unlock(&swp_lock);
+
+  return MEMPHY_put_freefp(mp, fpn);
+}
+
+/*
+ *  init_swap - register the MEMSWP devices
+ *  @mswp: array of devices, the ones of size 0 are not used
+ *  @nr: number of devices in the array
+ *
+ *  The swap type of a device is its rank among the used ones, so it
+ *  matches the MEMSWP index when the used devices come first.
+ */
+int init_swap(struct memphy_struct *mswp, int nr)
+{
+  int it;
+
+  swp.nr_dev = 0;
+  swp.cursor = 0;
+  for (it = 0; it < nr && it < PAGING_MAX_MMSWP; it++)
+  {
+    if (mswp[it].maxsz / PAGING_PAGESZ <= 0)
+      continue;
+
+    swp.nr_out[swp.nr_dev] = swp.nr_in[swp.nr_dev] = 0;
+    swp.dev[swp.nr_dev++] = &mswp[it];
+  }
+
+  return (swp.nr_dev > 0) ? 0 : -1;
+}
+
+int print_swap(void)
+{
+  int it;
+
+  printf("print_swap:");
+  for (it = 0; it < swp.nr_dev; it++)
+    printf(" swp%d[out %lu in %lu free %d]", it,
+           swp.nr_out[it], swp.nr_in[it], swp.dev[it]->free_fp_cnt);
+  printf("\n");
+  return 0;
+}
+
+//#endif
@@ -6,6 +6,7 @@
 
 #include "string.h"
 #include "mm.h"
+#include "trace.h"
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -167,6 +168,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
   /*Allocate at the toproof */
   struct vm_rg_struct rgnode;
 
+  pthread_mutex_lock(&caller->mm->lock);
   if (get_free_vmrg_area(caller, vmaid, size, &rgnode) == 0)
   {
     caller->mm->symrgtbl[rgid].rg_start = rgnode.rg_start;
@@ -175,6 +177,7 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
 		// *alloc_addr = rgnode.rg_start;
 		*alloc_addr = caller->mm->symrgtbl[rgid].rg_start;
 
+    pthread_mutex_unlock(&caller->mm->lock);
     return 0;
   }
 
@@ -208,9 +211,33 @@ int __alloc(struct pcb_t *caller, int vmaid, int rgid, int size, int *alloc_addr
 
 	*alloc_addr = caller->mm->symrgtbl[rgid].rg_start;
 
+  pthread_mutex_unlock(&caller->mm->lock);
   return 0;
 }
 
+#ifdef MM_HUGEPAGE
+/*pg_split_partial - split the huge pages a region only partly covers
+ *@mm: memory region, its page table lock held
+ *@start: region start
+ *@end: region end
+ *
+ */
+static void pg_split_partial(struct mm_struct *mm, int start, int end)
+{
+  int edge[2] = { PAGING_PGN(start), PAGING_PGN(end - 1) };
+  int it;
+
+  for (it = 0; it < 2; it++)
+  {
+    int hstart = PAGING_HUGE_PGN(edge[it]) * PAGING_PAGESZ;
+
+    if (PAGING_PAGE_HUGE(PAGING_PTE_LOOKUP(mm, edge[it])) &&
+        (start > hstart || end < hstart + PAGING_HUGE_NR * PAGING_PAGESZ))
+      pte_split_huge(mm, edge[it]);
+  }
+}
+#endif
+
 /*__free - remove a region memory
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -226,16 +253,23 @@ int __free(struct pcb_t *caller, int vmaid, int rgid)
     return -1;
 
 		/* TODO: Manage the collect freed region to freerg_list */
+	pthread_mutex_lock(&caller->mm->lock);
 #ifndef MY_CODE
 	rgnode = *get_symrg_byid(caller->mm, rgid);
 	// rgnode.rg_end = get_symrg_byid(caller->mm, rgid)->rg_end;
 	// rgnode.rg_start = get_symrg_byid(caller->mm, rgid)->rg_start;
+#endif
+#ifdef MM_HUGEPAGE
+	/* Huge pages only partly freed go back to base pages */
+	if (rgnode.rg_start < rgnode.rg_end)
+		pg_split_partial(caller->mm, rgnode.rg_start, rgnode.rg_end);
 #endif
 	/*enlist the obsoleted memory region */
 	enlist_vm_freerg_list(caller->mm, &rgnode);
 	// enlist_vm_rg_node(caller->mm->mmap->vm_freerg_list,&rgnode);
 	caller->mm->symrgtbl[rgid].rg_start = 0;
 	caller->mm->symrgtbl[rgid].rg_end = 0;
+	pthread_mutex_unlock(&caller->mm->lock);
 
   return 0;
 }
@@ -264,6 +298,80 @@ int pgfree_data(struct pcb_t *proc, uint32_t reg_index)
    return __free(proc, 0, reg_index);
 }
 
+#ifdef MM_SWAP_RA
+/*pg_ra_window - update the swap read-ahead window on a fault
+ *@mm: memory region
+ *@pgn: faulted PGN
+ *
+ * Faults continuing a sequential stream grow the window, any other
+ * fault shrinks it.
+ */
+static int pg_ra_window(struct mm_struct *mm, int pgn)
+{
+	struct swap_ra_struct *ra = &mm->swap_ra;
+
+	ra->nr_fault++;
+
+	if (pgn == ra->last_pgn + 1 || pgn == ra->next_pgn)
+		ra->win = (ra->win == 0) ? 1 : ra->win * 2;
+	else
+		ra->win /= 2;
+
+	if (ra->win > PAGING_RA_MAX_WIN)
+		ra->win = PAGING_RA_MAX_WIN;
+
+	ra->last_pgn = pgn;
+	ra->next_pgn = pgn + ra->win + 1;
+
+	return ra->win;
+}
+
+/*pg_ra_collect - pick swapped pages following a fault for read-ahead
+ *@mm: memory region
+ *@pgn: faulted PGN
+ *@caller: caller
+ *@rapgn: return the prefetched PGNs
+ *@srctyp: return their swap types
+ *@srcfpn: return their swap frames
+ *@dstfpn: return the MEMRAM frames reserved for them
+ *
+ * Only free MEMRAM frames are used, read-ahead never evicts.
+ */
+static int pg_ra_collect(struct mm_struct *mm, int pgn, struct pcb_t *caller,
+			int *rapgn, int *srctyp, int *srcfpn, int *dstfpn)
+{
+	struct vm_area_struct *vma = mm->mmap;
+	int win = pg_ra_window(mm, pgn);
+	int nr = 0, it, endpgn;
+
+	/* Stay in the vm area of the faulted page */
+	while (vma != NULL && !(PAGING_PGN(vma->vm_start) <= pgn && pgn < PAGING_PGN(vma->vm_end)))
+		vma = vma->vm_next;
+	if (vma == NULL)
+		return 0;
+	endpgn = PAGING_PGN(vma->vm_end);
+
+	for (it = pgn + 1; it <= pgn + win && it < endpgn; it++)
+	{
+		pte_t pte = PAGING_PTE_LOOKUP(mm, it);
+
+		if (PAGING_PAGE_PRESENT(pte) || !PAGING_PAGE_SWAPPED(pte) ||
+		    swap_dev(PAGING_PTE_SWPTYP(pte)) == NULL)
+			break;
+		if (MEMPHY_get_freefp(caller->mram, &dstfpn[nr]) < 0)
+			break;
+
+		rapgn[nr] = it;
+		srctyp[nr] = PAGING_PTE_SWPTYP(pte);
+		srcfpn[nr] = PAGING_PTE_SWPOFF(pte);
+		nr++;
+	}
+	mm->swap_ra.nr_issued += nr;
+
+	return nr;
+}
+#endif
+
 /*pg_getpage - get the page in ram
  *@mm: memory region
  *@pagenum: PGN
@@ -273,93 +381,361 @@ int pgfree_data(struct pcb_t *proc, uint32_t reg_index)
  */
 int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
 {
-	uint32_t pte = mm->pgd[pgn];
+	pte_t pte = PAGING_PTE_LOOKUP(mm, pgn);
 
 	if (!PAGING_PAGE_PRESENT(pte))
 	{ /* Page is not online, make it actively living */
-		int vicpgn, swpfpn;
-		// int vicfpn;
-		// uint32_t vicpte;
+		int vicpgn, tgtfpn;
+		/* Target page first, followed by read-ahead pages */
+		int batchpgn[PAGING_RA_MAX_WIN + 1], srctyp[PAGING_RA_MAX_WIN + 1];
+		int srcfpn[PAGING_RA_MAX_WIN + 1], dstfpn[PAGING_RA_MAX_WIN + 1];
+		int nr = 1, it, run;
 
-    int tgtfpn = PAGING_SWP(pte);//the target frame storing our variable
+		if (!PAGING_PAGE_SWAPPED(pte))
+			return -1; /* Page has never been mapped */
 
-		/* TODO: Play with your paging theory here */
-		/* Find victim page */
-		if (find_victim_page(caller, caller->mm, &vicpgn) == 0)
-			return -1;
-		// get vicpgn
-		uint32_t vicpte = mm->pgd[vicpgn];
-		int vicfpn = PAGING_FPN(vicpte);
+		int tgtswpfpn = PAGING_PTE_SWPOFF(pte); //the swap frame storing our variable
 
-    /* Get free frame in MEMSWP */
-    MEMPHY_get_freefp(caller->active_mswp, &swpfpn);
+		/* Take a free frame kept by kswapd, only evict a victim
+		 * synchronously when MEMRAM is exhausted */
+		if (MEMPHY_get_freefp(caller->mram, &tgtfpn) < 0)
+		{
+			do
+			{
+				/* Find victim page, take one of another process
+				 * when none of ours is online */
+				if (find_victim_page(caller, mm, &vicpgn) == 0)
+				{
+					if (kswapd_steal_frame(caller, &tgtfpn) < 0)
+						return -1;
+				}
+				/* Copy victim frame to swap, reuse its frame */
+				else if (pg_swapout(caller, vicpgn, &tgtfpn) < 0)
+					return -1;
+			} while (tgtfpn < 0);
+
+			/* The eviction may have written the zswap entry of
+			 * this page back to MEMSWP, follow its PTE again */
+			pte = PAGING_PTE_LOOKUP(mm, pgn);
+			tgtswpfpn = PAGING_PTE_SWPOFF(pte);
+		}
 
+#ifdef MM_ZSWAP
+		if (PAGING_PTE_SWPTYP(pte) == PAGING_SWPTYP_ZSWAP)
+		{ /* Decompress from the pool, no device access */
+			zswap_load(tgtswpfpn, caller->mram, tgtfpn);
+
+			pte_set_fpn(&PAGING_PTE(mm, pgn), tgtfpn);
+			CLRBIT(PAGING_PTE(mm, pgn), PAGING_PTE_RAHEAD_MASK);
+			SETBIT(PAGING_PTE(mm, pgn), PAGING_PTE_HOT_MASK);
+			pte_changed(mm, pgn);
+			enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+#ifdef OS_TRACE
+			trace_instant(TRACE_PID_PROC, caller->pid, "mm", "fault",
+				"\"pgn\":%d,\"swptyp\":%d,\"readahead\":0", pgn, PAGING_SWPTYP_ZSWAP);
+#endif
 
-		/* Do swap frame from MEMRAM to MEMSWP and vice versa*/
-		/* Copy victim frame to swap */
-		__swap_cp_page(caller->mram, vicfpn, caller->active_mswp, swpfpn);
-		/* Copy target frame from swap to mem */
-		__swap_cp_page(caller->active_mswp, tgtfpn, caller->mram, vicfpn);
+			*fpn = tgtfpn;
+			return 0;
+		}
+#endif
 
-		/* Update page table */
-		pte_set_swap(&mm->pgd[vicpgn], 0, swpfpn);
+		batchpgn[0] = pgn;
+		srctyp[0] = PAGING_PTE_SWPTYP(pte);
+		srcfpn[0] = tgtswpfpn;
+		dstfpn[0] = tgtfpn;
+#ifdef MM_SWAP_RA
+		nr += pg_ra_collect(mm, pgn, caller, &batchpgn[1], &srctyp[1], &srcfpn[1], &dstfpn[1]);
+#endif
 
-		/* Update its online status of the target page */
-		// pte_set_fpn(&pte, tgtfpn);
-		pte_set_fpn(&mm->pgd[pgn], vicfpn);
+		/* Copy target frame (and read-ahead) from swap to mem,
+		 * one batch per run of pages on the same device */
+		for (it = 0; it < nr; it += run)
+		{
+			for (run = 1; it + run < nr && srctyp[it + run] == srctyp[it]; run++);
+			MEMPHY_cp_frames(swap_dev(srctyp[it]), &srcfpn[it], caller->mram, &dstfpn[it], run);
+		}
 
-		enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+		for (it = 0; it < nr; it++)
+		{
+			swap_put_freefp(srctyp[it], srcfpn[it]);
+
+			/* Update its online status of the target page */
+			pte_set_fpn(&PAGING_PTE(mm, batchpgn[it]), dstfpn[it]);
+			CLRBIT(PAGING_PTE(mm, batchpgn[it]), PAGING_PTE_RAHEAD_MASK);
+			CLRBIT(PAGING_PTE(mm, batchpgn[it]), PAGING_PTE_HOT_MASK);
+			if (it > 0)
+				SETBIT(PAGING_PTE(mm, batchpgn[it]), PAGING_PTE_RAHEAD_MASK);
+			else
+				SETBIT(PAGING_PTE(mm, batchpgn[it]), PAGING_PTE_HOT_MASK);
+			pte_changed(mm, batchpgn[it]);
+
+			enlist_pgn_node(&caller->mm->fifo_pgn, batchpgn[it]);
+		}
+#ifdef OS_TRACE
+		trace_instant(TRACE_PID_PROC, caller->pid, "mm", "fault",
+			"\"pgn\":%d,\"swptyp\":%d,\"readahead\":%d", pgn, srctyp[0], nr - 1);
+#endif
 	}
+#ifdef MM_SWAP_RA
+	else if (pte & PAGING_PTE_RAHEAD_MASK)
+	{ /* First touch of a read-ahead page */
+		CLRBIT(PAGING_PTE(mm, pgn), PAGING_PTE_RAHEAD_MASK);
+		pte_changed(mm, pgn);
+		mm->swap_ra.nr_hit++;
+	}
+#endif
 
-  *fpn = PAGING_FPN(pte);
+  *fpn = PAGING_PTE_FPN(PAGING_PTE_LOOKUP(mm, pgn));
 
   return 0;
 }
 
-/*pg_getval - read value at given offset
- *@mm: memory region
- *@addr: virtual address to acess 
- *@value: value
+/*pg_swapout - move an online page out to MEMSWP
+ *@caller: owner of the page
+ *@vicpgn: victim PGN
+ *@retfpn: return the MEMRAM frame released by the victim, -1 when
+ *         zswap kept it to grow its pool
  *
  */
-int pg_getval(struct mm_struct *mm, int addr, BYTE *data, struct pcb_t *caller)
+int pg_swapout(struct pcb_t *caller, int vicpgn, int *retfpn)
 {
-  int pgn = PAGING_PGN(addr);
-  int off = PAGING_OFFST(addr);
-  int fpn;
+	struct mm_struct *mm = caller->mm;
+	int vicfpn = PAGING_PTE_FPN(PAGING_PTE_LOOKUP(mm, vicpgn));
+	int hot = (PAGING_PTE_LOOKUP(mm, vicpgn) & PAGING_PTE_HOT_MASK) != 0;
+	int swptyp, swpfpn;
+
+#ifdef MM_HUGEPAGE
+	/* Swap works on base pages, split the huge page first */
+	if (pte_split_huge(mm, vicpgn) == 0)
+	{
+#ifdef OS_TRACE
+		trace_instant(TRACE_PID_PROC, caller->pid, "mm", "split",
+			"\"pgn\":%d", PAGING_HUGE_PGN(vicpgn));
+#endif
+	}
+#endif
 
-  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
-  if(pg_getpage(mm, pgn, &fpn, caller) != 0) 
-    return -1; /* invalid page access */
+#ifdef MM_SWAP_RA
+	/* Read-ahead page evicted before being touched */
+	if (PAGING_PTE_LOOKUP(mm, vicpgn) & PAGING_PTE_RAHEAD_MASK)
+	{
+		mm->swap_ra.nr_wasted++;
+		mm->swap_ra.win /= 2;
+	}
+#endif
 
-  int phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
+#ifdef MM_ZSWAP
+	/* Compress into the pool, MEMSWP only gets what does not fit */
+	int zidx, zret;
+	if ((zret = zswap_store(mm, vicpgn, vicfpn, &zidx)) >= 0)
+	{
+		pte_set_swap(&PAGING_PTE(mm, vicpgn), PAGING_SWPTYP_ZSWAP, zidx);
+		pte_changed(mm, vicpgn);
+		delist_pgn_node(&mm->fifo_pgn, vicpgn);
+#ifdef OS_TRACE
+		trace_instant(TRACE_PID_PROC, caller->pid, "mm", "swapout",
+			"\"pgn\":%d,\"swptyp\":%d", vicpgn, PAGING_SWPTYP_ZSWAP);
+#endif
+		/* A frame kept by the pool is not released */
+		*retfpn = (zret == 0) ? vicfpn : -1;
+		return 0;
+	}
+#endif
+
+	/* Get free frame in MEMSWP */
+	if (swap_get_freefp(hot, &swptyp, &swpfpn) < 0)
+		return -1;
 
-  MEMPHY_read(caller->mram,phyaddr, data);
+	/* Copy victim frame to swap */
+	__swap_cp_page(caller->mram, vicfpn, swap_dev(swptyp), swpfpn);
 
+	/* Update page table */
+	pte_set_swap(&PAGING_PTE(mm, vicpgn), swptyp, swpfpn);
+	pte_changed(mm, vicpgn);
+	delist_pgn_node(&mm->fifo_pgn, vicpgn);
+#ifdef OS_TRACE
+	trace_instant(TRACE_PID_PROC, caller->pid, "mm", "swapout",
+		"\"pgn\":%d,\"swptyp\":%d", vicpgn, swptyp);
+#endif
+
+	*retfpn = vicfpn;
+	return 0;
+}
+
+/*pg_huge_tail - pages after pgn up to the end of its huge page
+ *@mm: memory region
+ *@pgn: online page
+ *
+ * Frames of a huge page are contiguous, one translation spans them
+ */
+static inline int pg_huge_tail(struct mm_struct *mm, int pgn)
+{
+#ifdef MM_HUGEPAGE
+  if (PAGING_PAGE_HUGE(PAGING_PTE_LOOKUP(mm, pgn)))
+    return PAGING_HUGE_NR - 1 - (pgn & (PAGING_HUGE_NR - 1));
+#endif
   return 0;
 }
 
-/*pg_setval - write value to given offset
+/*
+ * Byte and range access paths, one set per supported page size. The
+ * page shift is a literal in each, the split of addr into PGN and offset
+ * and the frame address need no lookup of the page geometry.
+ */
+#define PG_ACCESS_FNS(shift)                                                 \
+static int pg_getval_##shift(struct mm_struct *mm, addr_t addr, BYTE *data,  \
+                             struct pcb_t *caller)                           \
+{                                                                            \
+  int fpn;                                                                   \
+  pthread_mutex_lock(&mm->lock);                                             \
+  if (pg_getpage(mm, (addr & PAGING_ADDR_MASK) >> shift, &fpn, caller) != 0) \
+  {                                                                          \
+    pthread_mutex_unlock(&mm->lock);                                         \
+    return -1; /* invalid page access */                                     \
+  }                                                                          \
+  MEMPHY_read(caller->mram, ((addr_t)fpn << shift) + (addr & (BIT(shift) - 1)), data);\
+  pthread_mutex_unlock(&mm->lock);                                           \
+  return 0;                                                                  \
+}                                                                            \
+static int pg_setval_##shift(struct mm_struct *mm, addr_t addr, BYTE value,  \
+                             struct pcb_t *caller)                           \
+{                                                                            \
+  int fpn;                                                                   \
+  pthread_mutex_lock(&mm->lock);                                             \
+  if (pg_getpage(mm, (addr & PAGING_ADDR_MASK) >> shift, &fpn, caller) != 0) \
+  {                                                                          \
+    pthread_mutex_unlock(&mm->lock);                                         \
+    return -1; /* invalid page access */                                     \
+  }                                                                          \
+  MEMPHY_write(caller->mram, ((addr_t)fpn << shift) + (addr & (BIT(shift) - 1)), value);\
+  pthread_mutex_unlock(&mm->lock);                                           \
+  return 0;                                                                  \
+}                                                                            \
+static int pg_rwrange_##shift(struct mm_struct *mm, addr_t addr, BYTE *buf,  \
+                              int len, int wr, struct pcb_t *caller)         \
+{                                                                            \
+  int ret = 0;                                                               \
+  /* One hold for the whole span, kswapd skips a busy mm */                  \
+  pthread_mutex_lock(&mm->lock);                                             \
+  while (len > 0 && ret == 0)                                                \
+  {                                                                          \
+    int pgn = (addr & PAGING_ADDR_MASK) >> shift;                            \
+    int off = addr & (BIT(shift) - 1);                                       \
+    int chunk, fpn;                                                          \
+    if (pg_getpage(mm, pgn, &fpn, caller) != 0)                              \
+    {                                                                        \
+      ret = -1; /* invalid page access */                                    \
+      break;                                                                 \
+    }                                                                        \
+    chunk = ((1 + pg_huge_tail(mm, pgn)) << shift) - off;                    \
+    if (chunk > len)                                                         \
+      chunk = len;                                                           \
+    addr_t phyaddr = ((addr_t)fpn << shift) + off;                           \
+    if (wr)                                                                  \
+      ret = MEMPHY_write_block(caller->mram, phyaddr, buf, chunk);           \
+    else                                                                     \
+      ret = MEMPHY_read_block(caller->mram, phyaddr, buf, chunk);            \
+    addr += chunk;                                                           \
+    buf += chunk;                                                            \
+    len -= chunk;                                                            \
+  }                                                                          \
+  pthread_mutex_unlock(&mm->lock);                                           \
+  return (ret != 0) ? -1 : 0;                                                \
+}
+
+PG_ACCESS_FNS(8)
+PG_ACCESS_FNS(9)
+PG_ACCESS_FNS(10)
+PG_ACCESS_FNS(11)
+PG_ACCESS_FNS(12)
+
+#define PG_GEOM(shift) \
+  { BIT(shift), shift, BIT(PAGING_CPU_BUS_WIDTH - shift), \
+    pg_getval_##shift, pg_setval_##shift, pg_rwrange_##shift }
+
+static const struct paging_geom_t paging_geoms[] = {
+  PG_GEOM(8), PG_GEOM(9), PG_GEOM(10), PG_GEOM(11), PG_GEOM(12),
+};
+
+const struct paging_geom_t *paging_geom = &paging_geoms[0];
+
+int iodump_quiet = 0;
+
+/*paging_set_pagesz - select the page size of the run
+ *@pagesz: bytes per page, a power of 2 from PAGING_PAGESZ_MIN to
+ *         PAGING_PAGESZ_MAX
+ *
+ * Must be called before any MEMPHY or mm is set up
+ */
+int paging_set_pagesz(int pagesz)
+{
+  int it;
+
+  for (it = 0; it < sizeof(paging_geoms) / sizeof(paging_geoms[0]); it++)
+  {
+    if (paging_geoms[it].pagesz == pagesz)
+    {
+      paging_geom = &paging_geoms[it];
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/*pg_getval - read value at given offset
  *@mm: memory region
  *@addr: virtual address to acess 
  *@value: value
  *
  */
-int pg_setval(struct mm_struct *mm, int addr, BYTE value, struct pcb_t *caller)
+int pg_getval(struct mm_struct *mm, addr_t addr, BYTE *data, struct pcb_t *caller)
 {
-  int pgn = PAGING_PGN(addr);
-  int off = PAGING_OFFST(addr);
-  int fpn;
+  return paging_geom->getval(mm, addr, data, caller);
+}
 
-  /* Get the page to MEMRAM, swap from MEMSWAP if needed */
-  if(pg_getpage(mm, pgn, &fpn, caller) != 0) 
-    return -1; /* invalid page access */
+/*pg_setval - write value to given offset
+ *@mm: memory region
+ *@addr: virtual address to acess 
+ *@value: value
+ *
+ */
+int pg_setval(struct mm_struct *mm, addr_t addr, BYTE value, struct pcb_t *caller)
+{
+  return paging_geom->setval(mm, addr, value, caller);
+}
 
-  int phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
+/*pg_rwrange - copy a span of virtual memory, one translation per page
+ *@mm: memory region
+ *@addr: first virtual address
+ *@buf: source or destination buffer
+ *@len: number of bytes
+ *@wr: write buf to memory instead of reading
+ *
+ */
+static int pg_rwrange(struct mm_struct *mm, addr_t addr, BYTE *buf, int len,
+                      int wr, struct pcb_t *caller)
+{
+  return paging_geom->rwrange(mm, addr, buf, len, wr, caller);
+}
 
-  MEMPHY_write(caller->mram,phyaddr, value);
+/*pg_rg_rwrange - copy a span of an already resolved region
+ *@caller: caller
+ *@rg: region
+ *@offset: first offset to acess in the region
+ *@buf: source or destination buffer
+ *@size: number of bytes
+ *@wr: write buf to memory instead of reading
+ *
+ */
+static int pg_rg_rwrange(struct pcb_t *caller, struct vm_rg_struct *rg, int offset,
+                         BYTE *buf, int size, int wr)
+{
+  if (offset < 0 || size < 0 || offset + size > rg->rg_end - rg->rg_start)
+    return -1;
 
-   return 0;
+  return pg_rwrange(caller->mm, rg->rg_start + offset, buf, size, wr, caller);
 }
 
 /*__read - read value in region memory
@@ -379,9 +755,7 @@ int __read(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *data)
   if(currg == NULL || cur_vma == NULL) /* Invalid memory identify */
 	  return -1;
 
-  pg_getval(caller->mm, currg->rg_start + offset, data, caller);
-
-  return 0;
+  return pg_getval(caller->mm, currg->rg_start + offset, data, caller);
 }
 
 
@@ -407,13 +781,23 @@ int pgread(
   BYTE data;
   int val = __read(proc, 0, source, offset, &data);
 
+	if (val != 0)
+	{ /* No frame could be found for the page, data is not valid */
+		printf("Failed Reading: region %d offset %d could not be paged in\n",
+			   source, offset);
+		return val;
+	}
+
   destination = (uint32_t) data;
 #ifdef IODUMP
-  printf("read region=%d offset=%d value=%d\n", source, offset, data);
+  if (!iodump_quiet)
+  {
+    printf("read region=%d offset=%d value=%d\n", source, offset, data);
 #ifdef PAGETBL_DUMP
-  print_pgtbl(proc, 0, -1); //print max TBL
+    print_pgtbl_delta(proc);
 #endif
-  MEMPHY_dump(proc->mram);
+    MEMPHY_dump(proc->mram);
+  }
 #endif
 
   return val;
@@ -436,9 +820,49 @@ int __write(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE value)
   if(currg == NULL || cur_vma == NULL) /* Invalid memory identify */
 	  return -1;
 
-  pg_setval(caller->mm, currg->rg_start + offset, value, caller);
+  return pg_setval(caller->mm, currg->rg_start + offset, value, caller);
+}
 
-  return 0;
+/*__read_range - read a span of region memory
+ *@caller: caller
+ *@vmaid: ID vm area of the region
+ *@rgid: memory region ID (used to identify variable in symbole table)
+ *@offset: first offset to acess in memory region
+ *@buf: obtained values
+ *@size: number of bytes
+ *
+ */
+int __read_range(struct pcb_t *caller, int vmaid, int rgid, int offset, BYTE *buf, int size)
+{
+  struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
+
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if(currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+	  return -1;
+
+  return pg_rg_rwrange(caller, currg, offset, buf, size, 0);
+}
+
+/*__write_range - write a span of region memory
+ *@caller: caller
+ *@vmaid: ID vm area of the region
+ *@rgid: memory region ID (used to identify variable in symbole table)
+ *@offset: first offset to acess in memory region
+ *@buf: written values
+ *@size: number of bytes
+ *
+ */
+int __write_range(struct pcb_t *caller, int vmaid, int rgid, int offset, const BYTE *buf, int size)
+{
+  struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
+
+  struct vm_area_struct *cur_vma = get_vma_by_num(caller->mm, vmaid);
+
+  if(currg == NULL || cur_vma == NULL) /* Invalid memory identify */
+	  return -1;
+
+  return pg_rg_rwrange(caller, currg, offset, (BYTE *)buf, size, 1);
 }
 
 /*pgwrite - PAGING-based write a region memory */
@@ -460,40 +884,325 @@ int pgwrite(
 		return -1;
 	}
 #ifdef IODUMP
-  printf("write region=%d offset=%d value=%d\n", destination, offset, data);
+  if (!iodump_quiet)
+  {
+    printf("write region=%d offset=%d value=%d\n", destination, offset, data);
 #ifdef PAGETBL_DUMP
-  print_pgtbl(proc, 0, -1); //print max TBL
+    print_pgtbl_delta(proc);
 #endif
-  MEMPHY_dump(proc->mram);
+    MEMPHY_dump(proc->mram);
+  }
 #endif
 
-  return __write(proc, 0, destination, offset, data);
+  int val = __write(proc, 0, destination, offset, data);
+
+	if (val != 0)
+		printf("Failed Writing: region %d offset %d could not be paged in\n",
+			   destination, offset);
+
+  return val;
+}
+
+/*pg_rg_fits - check that a block from offset 0 stays inside a region
+ *@rg: region, NULL if its ID is invalid
+ *@size: number of bytes
+ */
+static int pg_rg_fits(struct vm_rg_struct *rg, uint32_t size)
+{
+  return rg != NULL && size <= rg->rg_end - rg->rg_start;
+}
+
+/*pg_rg_frame - translate an offset of a region to MEMRAM
+ *@caller: caller, its mm->lock is held
+ *@rg: region
+ *@offset: offset in the region
+ *@phyaddr: return the physical address
+ *@left: return the number of bytes up to the end of the page
+ */
+static int pg_rg_frame(struct pcb_t *caller, struct vm_rg_struct *rg, uint32_t offset,
+                       addr_t *phyaddr, int *left)
+{
+  addr_t addr = rg->rg_start + offset;
+  int fpn;
+
+  if (pg_getpage(caller->mm, PAGING_PGN(addr), &fpn, caller) != 0)
+    return -1; /* invalid page access */
+
+  *phyaddr = ((addr_t)fpn << PAGING_PAGE_SHIFT) + PAGING_OFFST(addr);
+  *left = PAGING_PAGESZ - PAGING_OFFST(addr);
+  return 0;
+}
+
+/*pg_rg_frame2 - translate the same offset of two regions to MEMRAM
+ *@caller: caller, its mm->lock is held
+ *@rg0: first region
+ *@rg1: second region
+ *@offset: offset in both regions
+ *@phy0: return the physical address in the first region
+ *@phy1: return the physical address in the second region
+ *@left: return the number of bytes up to the nearest end of page
+ *
+ * Paging in the second page may evict the first one, both are
+ * translated again until they are online together
+ */
+static int pg_rg_frame2(struct pcb_t *caller, struct vm_rg_struct *rg0,
+                        struct vm_rg_struct *rg1, uint32_t offset,
+                        addr_t *phy0, addr_t *phy1, int *left)
+{
+  int pgn0 = PAGING_PGN(rg0->rg_start + offset);
+  int left0, left1, retry;
+  pte_t pte;
+
+  for (retry = 0; retry < PAGING_PAIR_RETRY; retry++)
+  {
+    if (pg_rg_frame(caller, rg0, offset, phy0, &left0) != 0 ||
+        pg_rg_frame(caller, rg1, offset, phy1, &left1) != 0)
+      return -1;
+
+    pte = PAGING_PTE_LOOKUP(caller->mm, pgn0);
+    if (PAGING_PAGE_PRESENT(pte) &&
+        PAGING_PTE_FPN(pte) == *phy0 >> PAGING_PAGE_SHIFT)
+    {
+      *left = (left0 < left1) ? left0 : left1;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+/*pgcopy - PAGING-based copy between two region memories
+ *@proc: Process executing the instruction
+ *@source: index of source region
+ *@destination: index of destination region
+ *@size: number of bytes, from offset 0 of both regions
+ */
+int pgcopy(struct pcb_t *proc, uint32_t source, uint32_t destination, uint32_t size)
+{
+  struct vm_rg_struct *srcrg = get_symrg_byid(proc->mm, source);
+  struct vm_rg_struct *dstrg = get_symrg_byid(proc->mm, destination);
+  addr_t srcaddr, dstaddr;
+  uint32_t off;
+  int len, ret = 0;
+
+  /* Nothing is written unless the whole block fits in both regions */
+  if (!pg_rg_fits(srcrg, size) || !pg_rg_fits(dstrg, size))
+  {
+    printf("Invalid Copy: region %d to %d of size %d\n", source, destination, size);
+    return -1;
+  }
+
+#ifdef IODUMP
+  if (!iodump_quiet)
+    printf("copy region=%d region=%d size=%d\n", source, destination, size);
+#endif
+
+  /* Chunks end at a page boundary of either side, frame to frame */
+  pthread_mutex_lock(&proc->mm->lock);
+  for (off = 0; off < size && ret == 0; off += len)
+  {
+    ret = pg_rg_frame2(proc, srcrg, dstrg, off, &srcaddr, &dstaddr, &len);
+    if (ret == 0)
+    {
+      if (len > size - off)
+        len = size - off;
+      ret = MEMPHY_copy_block(proc->mram, dstaddr, srcaddr, len);
+    }
+  }
+  pthread_mutex_unlock(&proc->mm->lock);
+
+  if (ret != 0)
+  {
+    printf("Invalid Copy: region %d to %d of size %d\n", source, destination, size);
+    return -1;
+  }
+
+#ifdef IODUMP
+  if (!iodump_quiet)
+  {
+#ifdef PAGETBL_DUMP
+    print_pgtbl_delta(proc);
+#endif
+    MEMPHY_dump(proc->mram);
+  }
+#endif
+
+  return 0;
+}
+
+/*pgfill - PAGING-based set of a region memory
+ *@proc: Process executing the instruction
+ *@data: value set to every byte
+ *@destination: index of destination region
+ *@size: number of bytes, from offset 0 of the region
+ */
+int pgfill(struct pcb_t *proc, BYTE data, uint32_t destination, uint32_t size)
+{
+  struct vm_rg_struct *dstrg = get_symrg_byid(proc->mm, destination);
+  addr_t dstaddr;
+  uint32_t off;
+  int len, ret = 0;
+
+  if (!pg_rg_fits(dstrg, size))
+  {
+    printf("Invalid Fill: region %d of size %d\n", destination, size);
+    return -1;
+  }
+
+#ifdef IODUMP
+  if (!iodump_quiet)
+    printf("fill region=%d value=%d size=%d\n", destination, data, size);
+#endif
+
+  pthread_mutex_lock(&proc->mm->lock);
+  for (off = 0; off < size && ret == 0; off += len)
+  {
+    ret = pg_rg_frame(proc, dstrg, off, &dstaddr, &len);
+    if (ret == 0)
+    {
+      if (len > size - off)
+        len = size - off;
+      ret = MEMPHY_set_block(proc->mram, dstaddr, data, len);
+    }
+  }
+  pthread_mutex_unlock(&proc->mm->lock);
+
+  if (ret != 0)
+  {
+    printf("Invalid Fill: region %d of size %d\n", destination, size);
+    return -1;
+  }
+
+#ifdef IODUMP
+  if (!iodump_quiet)
+  {
+#ifdef PAGETBL_DUMP
+    print_pgtbl_delta(proc);
+#endif
+    MEMPHY_dump(proc->mram);
+  }
+#endif
+
+  return 0;
+}
+
+/*pgcmp - PAGING-based comparison of two region memories
+ *@proc: Process executing the instruction
+ *@source: index of first region
+ *@destination: index of second region
+ *@size: number of bytes, from offset 0 of both regions
+ *
+ * The result (-1, 0 or 1) is returned in the compare register proc->cr
+ */
+int pgcmp(struct pcb_t *proc, uint32_t source, uint32_t destination, uint32_t size)
+{
+  struct vm_rg_struct *rg0 = get_symrg_byid(proc->mm, source);
+  struct vm_rg_struct *rg1 = get_symrg_byid(proc->mm, destination);
+  addr_t addr0, addr1;
+  uint32_t off;
+  int len, ret = 0, res = 0;
+
+  if (!pg_rg_fits(rg0, size) || !pg_rg_fits(rg1, size))
+  {
+    printf("Invalid Compare: region %d and %d of size %d\n", source, destination, size);
+    return -1;
+  }
+
+  pthread_mutex_lock(&proc->mm->lock);
+  for (off = 0; off < size && ret == 0 && res == 0; off += len)
+  {
+    ret = pg_rg_frame2(proc, rg0, rg1, off, &addr0, &addr1, &len);
+    if (ret == 0)
+    {
+      if (len > size - off)
+        len = size - off;
+      ret = MEMPHY_cmp_block(proc->mram, addr0, addr1, len, &res);
+    }
+  }
+  pthread_mutex_unlock(&proc->mm->lock);
+
+  if (ret != 0)
+  {
+    printf("Invalid Compare: region %d and %d of size %d\n", source, destination, size);
+    return -1;
+  }
+  proc->cr = (res > 0) - (res < 0);
+
+#ifdef IODUMP
+  if (!iodump_quiet)
+  {
+    printf("cmp region=%d region=%d size=%d result=%d\n", source, destination, size,
+           proc->cr);
+#ifdef PAGETBL_DUMP
+    print_pgtbl_delta(proc);
+#endif
+    MEMPHY_dump(proc->mram);
+  }
+#endif
+
+  return 0;
 }
 
 /*free_pcb_memphy - collect all memphy of pcb
  *@caller: caller
- *@vmaid: ID vm area to alloc memory region
- *@incpgnum: number of page
+ *
+ * Return the frames of a finished process to MEMRAM and MEMSWP and
+ * release its mm. Pages pooled in zswap are dropped by zswap_release.
  */
 int free_pcb_memph(struct pcb_t *caller)
 {
-  int pagenum, fpn;
-  uint32_t pte;
-
+  struct mm_struct *mm = caller->mm;
+  struct vm_area_struct *vma = mm->mmap;
+  int pgn, fpn;
+  pte_t pte;
 
-  for(pagenum = 0; pagenum < PAGING_MAX_PGN; pagenum++)
+  pthread_mutex_lock(&mm->lock);
+  while (vma != NULL)
   {
-    pte= caller->mm->pgd[pagenum];
+    struct vm_area_struct *vmanext = vma->vm_next;
+    struct vm_rg_struct *rg = vma->vm_freerg_list;
+
+    for (pgn = PAGING_PGN(vma->vm_start);
+         pgn < PAGING_PGN(PAGING_PAGE_ALIGNSZ(vma->vm_end)); pgn++)
+    {
+      pte = PAGING_PTE_LOOKUP(mm, pgn);
+
+      if (PAGING_PAGE_PRESENT(pte))
+      {
+        fpn = PAGING_PTE_FPN(pte);
+        MEMPHY_put_freefp(caller->mram, fpn);
+      }
+      else if (PAGING_PAGE_SWAPPED(pte) && PAGING_PTE_SWPTYP(pte) != PAGING_SWPTYP_ZSWAP)
+      {
+        fpn = PAGING_PTE_SWPOFF(pte);
+        MEMPHY_put_freefp(swap_dev(PAGING_PTE_SWPTYP(pte)), fpn);
+      }
+    }
 
-    if (!PAGING_PAGE_PRESENT(pte))
+    while (rg != NULL)
     {
-      fpn = PAGING_FPN(pte);
-      MEMPHY_put_freefp(caller->mram, fpn);
-    } else {
-      fpn = PAGING_SWP(pte);
-      MEMPHY_put_freefp(caller->active_mswp, fpn);    
+      struct vm_rg_struct *rgnext = rg->rg_next;
+      free(rg);
+      rg = rgnext;
     }
+    free(vma);
+    vma = vmanext;
+  }
+
+  while (mm->fifo_pgn != NULL)
+  {
+    struct pgn_t *pg = mm->fifo_pgn;
+    mm->fifo_pgn = pg->pg_next;
+    free(pg);
   }
+  mm->mmap = NULL;
+  pthread_mutex_unlock(&mm->lock);
+
+  pthread_mutex_destroy(&mm->lock);
+  for (pgn = 0; pgn < PAGING_PGD_NR; pgn++)
+    free(mm->pgd[pgn]);
+  free(mm->pgd);
+  free(mm->pgd_chg_list);
 
   return 0;
 }
@@ -646,21 +1355,20 @@ int find_victim_page(struct pcb_t *caller, struct mm_struct *mm, int *retpgn)
 	 */
 	if (pg == NULL)
 		return 0;
-	int flag_found = 0;
+	/* Pages are enlisted at the head when they come online and
+	 * delisted by pg_swapout, so the oldest online page (the FIFO
+	 * victim) is the last one in the list */
+	struct pgn_t *victim = NULL;
 	while (pg != NULL)
 	{
-		if (!PAGING_PAGE_PRESENT(mm->pgd[pg->pgn]))
-			pg = pg->pg_next;
-		else
-		{
-			flag_found = 1;
-			break;
-		}
+		if (PAGING_PAGE_PRESENT(PAGING_PTE_LOOKUP(mm, pg->pgn)))
+			victim = pg;
+		pg = pg->pg_next;
 	}
-	if (!flag_found)
+	if (victim == NULL)
 		return 0;
 
-	*retpgn = pg->pgn;
+	*retpgn = victim->pgn;
 	// mm->fifo_pgn = pg->pg_next;
 	// free(pg);
 	// pg = NULL;
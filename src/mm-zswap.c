@@ -0,0 +1,497 @@
+//#ifdef MM_ZSWAP
+/*
+ * PAGING based Memory Management
+ * Compressed swap cache mm/mm-zswap.c
+ *
+ * Evicted pages are compressed into a pool of MEMRAM frames instead of
+ * being copied to MEMSWP. Same-filled pages only keep their fill byte,
+ * other pages are packed with a run-length (PackBits) coder. Only when
+ * the pool is full the oldest entries are written back to MEMSWP, so
+ * most swap-ins are a decompression rather than a device copy.
+ *
+ * A page in the pool has PTE swap type PAGING_SWPTYP_ZSWAP and its swap
+ * offset is the index of its zswap entry.
+ */
+
+#include "mm.h"
+#include "lockprof.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+struct zswap_entry {
+   struct mm_struct *owner; /* NULL when the entry is free */
+   int pgn;
+
+   int pfidx;  /* pool frame index, -1 for same-filled page */
+   int off;
+   int len;
+   BYTE fill;
+
+   /* Age list of live entries, free list of unused ones */
+   int prev;
+   int next;
+};
+
+struct zswap_pool_frame {
+   int fpn;  /* -1 when the slot holds no MEMRAM frame */
+   int used; /* bytes handed out from the frame start */
+   int nobj; /* live objects in the frame */
+};
+
+static struct {
+   struct memphy_struct *mram;
+
+   struct zswap_pool_frame *pf;
+   int nr_pf;  /* frames currently lent by MEMRAM */
+   int max_pf;
+   int open_pf; /* frame receiving new objects, -1 if none */
+
+   struct zswap_entry *ent;
+   int nr_ent;
+   int free_ent;
+   int oldest;
+   int newest;
+
+   unsigned long nr_stored;
+   unsigned long nr_same_filled;
+   unsigned long nr_rejected;
+   unsigned long nr_loaded;
+   unsigned long nr_written_back;
+} zswap;
+
+static pthread_mutex_t zswap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ *  zswap_compress - PackBits encode a page
+ *  @src: page content
+ *  @n: page size
+ *  @dst: output buffer
+ *  @dstmax: output buffer size
+ *
+ *  Return the encoded length, -1 if it does not fit in dstmax.
+ */
+static int zswap_compress(const BYTE *src, int n, BYTE *dst, int dstmax)
+{
+  int i = 0, o = 0;
+
+  while (i < n)
+  {
+    int run = 1;
+
+    while (i + run < n && run < 128 && src[i + run] == src[i])
+      run++;
+
+    if (run >= 3)
+    { /* Repeated run: header 257 - run, then the byte */
+      if (o + 2 > dstmax)
+        return -1;
+      dst[o++] = (BYTE)(257 - run);
+      dst[o++] = src[i];
+      i += run;
+    }
+    else
+    { /* Literal run up to the next repeated run: header len - 1 */
+      int lit = 0;
+
+      while (i + lit < n && lit < 128)
+      {
+        if (i + lit + 2 < n && src[i + lit] == src[i + lit + 1] &&
+            src[i + lit] == src[i + lit + 2])
+          break;
+        lit++;
+      }
+      if (o + 1 + lit > dstmax)
+        return -1;
+      dst[o++] = (BYTE)(lit - 1);
+      memcpy(dst + o, src + i, lit);
+      o += lit;
+      i += lit;
+    }
+  }
+
+  return o;
+}
+
+/*
+ *  zswap_decompress - PackBits decode a page
+ *  @src: encoded data
+ *  @len: encoded length
+ *  @dst: page buffer
+ *  @n: page size
+ */
+static int zswap_decompress(const BYTE *src, int len, BYTE *dst, int n)
+{
+  int i = 0, o = 0;
+
+  while (i < len && o < n)
+  {
+    int hdr = (unsigned char)src[i++];
+
+    if (hdr < 128)
+    { /* Literal run */
+      memcpy(dst + o, src + i, hdr + 1);
+      i += hdr + 1;
+      o += hdr + 1;
+    }
+    else
+    { /* Repeated run */
+      memset(dst + o, src[i++], 257 - hdr);
+      o += 257 - hdr;
+    }
+  }
+
+  return (o == n) ? 0 : -1;
+}
+
+static BYTE *zswap_pf_addr(int pfidx, int off)
+{
+  return zswap.mram->storage + PAGING_FRAME_ADDR(zswap.pf[pfidx].fpn) + off;
+}
+
+static void zswap_age_unlink(int idx)
+{
+  struct zswap_entry *e = &zswap.ent[idx];
+
+  if (e->prev >= 0) zswap.ent[e->prev].next = e->next;
+  else zswap.oldest = e->next;
+  if (e->next >= 0) zswap.ent[e->next].prev = e->prev;
+  else zswap.newest = e->prev;
+}
+
+static int zswap_alloc_entry(void)
+{
+  int idx, it;
+
+  if (zswap.free_ent < 0)
+  { /* Grow the entry table */
+    int nr = (zswap.nr_ent == 0) ? 64 : zswap.nr_ent * 2;
+
+    if (nr > PAGING_PTE_SWPOFF_MASK >> PAGING_PTE_SWPOFF_LOBIT)
+      return -1; /* Index would not fit in the PTE */
+
+    zswap.ent = realloc(zswap.ent, nr * sizeof(struct zswap_entry));
+    for (it = zswap.nr_ent; it < nr; it++)
+    {
+      zswap.ent[it].owner = NULL;
+      zswap.ent[it].next = (it + 1 < nr) ? it + 1 : -1;
+    }
+    zswap.free_ent = zswap.nr_ent;
+    zswap.nr_ent = nr;
+  }
+
+  idx = zswap.free_ent;
+  zswap.free_ent = zswap.ent[idx].next;
+
+  /* Enlist as newest */
+  zswap.ent[idx].prev = zswap.newest;
+  zswap.ent[idx].next = -1;
+  if (zswap.newest >= 0) zswap.ent[zswap.newest].next = idx;
+  else zswap.oldest = idx;
+  zswap.newest = idx;
+
+  return idx;
+}
+
+/*
+ *  zswap_free_entry - drop an entry and its pool object
+ *  @idx: entry index
+ */
+static void zswap_free_entry(int idx)
+{
+  struct zswap_entry *e = &zswap.ent[idx];
+
+  if (e->pfidx >= 0)
+  {
+    struct zswap_pool_frame *pf = &zswap.pf[e->pfidx];
+
+    if (--pf->nobj == 0)
+    {
+      pf->used = 0;
+      if (e->pfidx != zswap.open_pf)
+      { /* Give the empty frame back to MEMRAM */
+        MEMPHY_put_freefp(zswap.mram, pf->fpn);
+        pf->fpn = -1;
+        zswap.nr_pf--;
+      }
+    }
+  }
+
+  zswap_age_unlink(idx);
+  e->owner = NULL;
+  e->next = zswap.free_ent;
+  zswap.free_ent = idx;
+}
+
+/*
+ *  zswap_writeback_one - move the oldest writable entry to MEMSWP
+ *  @self: mm already locked by the caller
+ *
+ *  Entries of other processes are only written back when their page
+ *  table can be locked without waiting.
+ */
+static int zswap_writeback_one(struct mm_struct *self)
+{
+  BYTE page[PAGING_PAGESZ_MAX];
+  int idx, swptyp, swpfpn;
+
+  for (idx = zswap.oldest; idx >= 0; idx = zswap.ent[idx].next)
+  {
+    struct zswap_entry *e = &zswap.ent[idx];
+    struct mm_struct *owner = e->owner;
+
+    if (e->pfidx < 0)
+      continue; /* Same-filled pages hold no pool space */
+    if (owner != self && pthread_mutex_trylock(&owner->lock) != 0)
+      continue;
+
+    if (swap_get_freefp(0, &swptyp, &swpfpn) < 0)
+    {
+      if (owner != self)
+        pthread_mutex_unlock(&owner->lock);
+      return -1;
+    }
+
+    zswap_decompress(zswap_pf_addr(e->pfidx, e->off), e->len, page, PAGING_PAGESZ);
+    MUTEX_LOCK(&lock_mem);
+    memcpy(swap_dev(swptyp)->storage + PAGING_FRAME_ADDR(swpfpn), page, PAGING_PAGESZ);
+    MUTEX_UNLOCK(&lock_mem);
+    MEMPHY_mark_dirty(swap_dev(swptyp), swpfpn);
+
+    pte_set_swap(&PAGING_PTE(owner, e->pgn), swptyp, swpfpn);
+    pte_changed(owner, e->pgn);
+    if (owner != self)
+      pthread_mutex_unlock(&owner->lock);
+
+    zswap_free_entry(idx);
+    zswap.nr_written_back++;
+    return 0;
+  }
+
+  return -1;
+}
+
+/*
+ *  zswap_reserve - find pool space for an object
+ *  @self: mm already locked by the caller
+ *  @len: object size
+ *  @off: return offset in the frame
+ *  @spare: frame of the page being stored, set to -1 when the pool
+ *          takes it because MEMRAM has no free frame left
+ *
+ *  Return the pool frame index, -1 if the pool cannot make room.
+ */
+static int zswap_reserve(struct mm_struct *self, int len, int *off, int *spare)
+{
+  int fpn, tries;
+
+  for (tries = 0; tries <= zswap.nr_ent; tries++)
+  {
+    struct zswap_pool_frame *pf;
+
+    if (zswap.open_pf >= 0)
+    {
+      pf = &zswap.pf[zswap.open_pf];
+      if (pf->used + len <= PAGING_PAGESZ)
+      {
+        *off = pf->used;
+        pf->used += len;
+        pf->nobj++;
+        return zswap.open_pf;
+      }
+    }
+
+    /* Switch to a frame emptied by invalidation, then to a new one */
+    int it, slot = -1;
+    for (it = 0; it < zswap.max_pf; it++)
+    {
+      if (zswap.pf[it].fpn >= 0 && zswap.pf[it].nobj == 0 && it != zswap.open_pf)
+        break;
+      if (zswap.pf[it].fpn < 0 && slot < 0)
+        slot = it;
+    }
+    if (it < zswap.max_pf)
+    {
+      zswap.open_pf = it;
+      continue;
+    }
+    if (slot >= 0 && MEMPHY_get_freefp(zswap.mram, &fpn) < 0)
+    { /* MEMRAM is full, the pool grows by the frame being evicted */
+      fpn = *spare;
+      *spare = -1;
+    }
+    if (slot >= 0 && fpn >= 0)
+    {
+      zswap.pf[slot].fpn = fpn;
+      zswap.pf[slot].used = 0;
+      zswap.pf[slot].nobj = 0;
+      zswap.open_pf = slot;
+      zswap.nr_pf++;
+      continue;
+    }
+
+    /* Pool is full, push the oldest objects to MEMSWP */
+    if (zswap_writeback_one(self) < 0)
+      return -1;
+  }
+
+  return -1;
+}
+
+/*
+ *  zswap_store - compress an online page into the pool
+ *  @mm: owner, locked by the caller
+ *  @pgn: page number
+ *  @fpn: MEMRAM frame holding the page
+ *  @retidx: return the zswap entry index
+ *
+ *  Return 1 when the pool kept the frame of the page for itself, MEMRAM
+ *  being full, 0 when the frame can be reused, and -1 when the page
+ *  does not compress well or the pool is full, the caller then swaps it
+ *  out to MEMSWP.
+ */
+int zswap_store(struct mm_struct *mm, int pgn, int fpn, int *retidx)
+{
+  BYTE buf[PAGING_PAGESZ_MAX];
+  BYTE *page;
+  int len, it, idx, pfidx = -1, off = 0, spare = fpn;
+
+  if (zswap.mram == NULL)
+    return -1;
+
+  page = zswap.mram->storage + PAGING_FRAME_ADDR(fpn);
+
+  pthread_mutex_lock(&zswap_lock);
+
+  /* Entry first, the pool may take the page frame and overwrite it */
+  if ((idx = zswap_alloc_entry()) < 0)
+  {
+    zswap.nr_rejected++;
+    pthread_mutex_unlock(&zswap_lock);
+    return -1;
+  }
+  zswap.ent[idx].owner = mm;
+  zswap.ent[idx].pgn = pgn;
+  zswap.ent[idx].pfidx = -1; /* Not written back while being stored */
+  zswap.ent[idx].off = 0;
+  zswap.ent[idx].len = 0;
+  zswap.ent[idx].fill = page[0];
+
+  for (it = 1; it < PAGING_PAGESZ && page[it] == page[0]; it++);
+
+  if (it == PAGING_PAGESZ)
+    len = 0; /* Same-filled */
+  else
+  {
+    len = zswap_compress(page, PAGING_PAGESZ, buf, PAGING_PAGESZ * PAGING_ZSWAP_MAX_RATIO / 100);
+    if (len < 0 || (pfidx = zswap_reserve(mm, len, &off, &spare)) < 0)
+    {
+      zswap_free_entry(idx);
+      zswap.nr_rejected++;
+      pthread_mutex_unlock(&zswap_lock);
+      return -1;
+    }
+    memcpy(zswap_pf_addr(pfidx, off), buf, len);
+    MEMPHY_mark_dirty(zswap.mram, zswap.pf[pfidx].fpn);
+    zswap.ent[idx].pfidx = pfidx;
+    zswap.ent[idx].off = off;
+    zswap.ent[idx].len = len;
+  }
+
+  zswap.nr_stored++;
+  if (pfidx < 0)
+    zswap.nr_same_filled++;
+
+  pthread_mutex_unlock(&zswap_lock);
+
+  *retidx = idx;
+  return (spare < 0) ? 1 : 0;
+}
+
+/*
+ *  zswap_load - decompress a pooled page and drop its entry
+ *  @idx: zswap entry index
+ *  @mp: destination memphy
+ *  @fpn: destination frame
+ */
+int zswap_load(int idx, struct memphy_struct *mp, int fpn)
+{
+  BYTE *page = mp->storage + PAGING_FRAME_ADDR(fpn);
+  struct zswap_entry *e;
+
+  pthread_mutex_lock(&zswap_lock);
+  e = &zswap.ent[idx];
+
+  /* A concurrent MEMPHY_dump must not see a half written frame */
+  MUTEX_LOCK(&lock_mem);
+  if (e->pfidx < 0)
+    memset(page, e->fill, PAGING_PAGESZ);
+  else
+    zswap_decompress(zswap_pf_addr(e->pfidx, e->off), e->len, page, PAGING_PAGESZ);
+  MUTEX_UNLOCK(&lock_mem);
+
+  MEMPHY_mark_dirty(mp, fpn);
+
+  zswap_free_entry(idx);
+  zswap.nr_loaded++;
+  pthread_mutex_unlock(&zswap_lock);
+
+  return 0;
+}
+
+/*
+ *  zswap_release - drop every pooled page of a finished process
+ *  @mm: released mm
+ */
+int zswap_release(struct mm_struct *mm)
+{
+  int idx, next;
+
+  pthread_mutex_lock(&zswap_lock);
+  for (idx = zswap.oldest; idx >= 0; idx = next)
+  {
+    next = zswap.ent[idx].next;
+    if (zswap.ent[idx].owner == mm)
+      zswap_free_entry(idx);
+  }
+  pthread_mutex_unlock(&zswap_lock);
+
+  return 0;
+}
+
+/*
+ *  init_zswap - set up the compressed pool
+ *  @mram: MEMRAM lending frames to the pool
+ */
+int init_zswap(struct memphy_struct *mram)
+{
+  int numfp = mram->maxsz / PAGING_PAGESZ;
+
+  zswap.mram = mram;
+
+  int it;
+
+  zswap.max_pf = numfp * PAGING_ZSWAP_MAX_PCT / 100;
+  zswap.pf = malloc((zswap.max_pf + 1) * sizeof(struct zswap_pool_frame));
+  for (it = 0; it < zswap.max_pf; it++)
+    zswap.pf[it].fpn = -1;
+  zswap.nr_pf = 0;
+  zswap.open_pf = -1;
+
+  zswap.ent = NULL;
+  zswap.nr_ent = 0;
+  zswap.free_ent = -1;
+  zswap.oldest = zswap.newest = -1;
+
+  return 0;
+}
+
+int print_zswap(void)
+{
+  printf("print_zswap: stored %lu same-filled %lu rejected %lu loaded %lu written-back %lu pool %d/%d frames\n",
+         zswap.nr_stored, zswap.nr_same_filled, zswap.nr_rejected,
+         zswap.nr_loaded, zswap.nr_written_back, zswap.nr_pf, zswap.max_pf);
+  return 0;
+}
+
+//#endif
@@ -7,11 +7,12 @@
 #include "mm.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 /* 
  * init_pte - Initialize PTE entry
  */
-int init_pte(uint32_t *pte,
+int init_pte(pte_t *pte,
              int pre,    // present
              int fpn,    // FPN
              int drt,    // dirty
@@ -29,7 +30,7 @@ int init_pte(uint32_t *pte,
       CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
       CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
 
-      SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
+      SETVAL(*pte, (pte_t)fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT);
       // SETVAL(v,value,mask,offst) (v=(v&~mask)|((value<<offst)&mask))
     }
     else
@@ -38,8 +39,8 @@ int init_pte(uint32_t *pte,
       SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
       CLRBIT(*pte, PAGING_PTE_DIRTY_MASK);
 
-      SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
-      SETVAL(*pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+      SETVAL(*pte, (pte_t)swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
+      SETVAL(*pte, (pte_t)swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
     }
   }
 
@@ -52,13 +53,13 @@ int init_pte(uint32_t *pte,
  * @swptyp : swap type
  * @swpoff : swap offset
  */
-int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
+int pte_set_swap(pte_t *pte, int swptyp, int swpoff)
 {
   CLRBIT(*pte, PAGING_PTE_PRESENT_MASK);
   SETBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
-  SETVAL(*pte, swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
-  SETVAL(*pte, swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
+  SETVAL(*pte, (pte_t)swptyp, PAGING_PTE_SWPTYP_MASK, PAGING_PTE_SWPTYP_LOBIT);
+  SETVAL(*pte, (pte_t)swpoff, PAGING_PTE_SWPOFF_MASK, PAGING_PTE_SWPOFF_LOBIT);
 
   return 0;
 }
@@ -68,16 +69,99 @@ int pte_set_swap(uint32_t *pte, int swptyp, int swpoff)
  * @pte   : target page table entry (PTE)
  * @fpn   : frame page number (FPN)
  */
-int pte_set_fpn(uint32_t *pte, int fpn)
+int pte_set_fpn(pte_t *pte, int fpn)
 {
   SETBIT(*pte, PAGING_PTE_PRESENT_MASK);
   CLRBIT(*pte, PAGING_PTE_SWAPPED_MASK);
 
-  SETVAL(*pte, fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT); 
+  SETVAL(*pte, (pte_t)fpn, PAGING_PTE_FPN_MASK, PAGING_PTE_FPN_LOBIT); 
 
   return 0;
 }
 
+/*
+ * pte_split_huge - turn the huge page holding a PTE back to base pages
+ * @mm  : owner mm, its page table lock held
+ * @pgn : any page of the huge page
+ *
+ * The frames stay in place, only the PTEs lose the HUGE bit. The huge
+ * page had one node in the FIFO list, its other pages are enlisted so
+ * that each can be evicted on its own.
+ */
+int pte_split_huge(struct mm_struct *mm, int pgn)
+{
+  int hpgn = PAGING_HUGE_PGN(pgn);
+  int it;
+
+  if (!PAGING_PAGE_HUGE(PAGING_PTE_LOOKUP(mm, pgn)))
+    return -1;
+
+  for (it = 0; it < PAGING_HUGE_NR; it++)
+  {
+    CLRBIT(PAGING_PTE(mm, hpgn + it), PAGING_PTE_HUGE_MASK);
+    pte_changed(mm, hpgn + it);
+    if (it > 0)
+      enlist_pgn_node(&mm->fifo_pgn, hpgn + it);
+  }
+
+  return 0;
+}
+
+/*
+ * pte_alloc - allocate the PTE table of a page on its first access
+ * @mm  : owner mm
+ * @pgn : page number
+ *
+ * Return the PTE of pgn, cleared as the rest of the new table. Read
+ * paths use PAGING_PTE_LOOKUP, which never allocates.
+ */
+pte_t *pte_alloc(struct mm_struct *mm, int pgn)
+{
+  pte_t **tbl = &mm->pgd[pgn >> PAGING_PTBL_SHIFT];
+
+  if (*tbl == NULL)
+  {
+    *tbl = calloc(PAGING_PTBL_NR, sizeof(pte_t));
+    if (*tbl == NULL)
+    { /* Callers write through the PTE, there is no way back */
+      printf("Out of memory for the page table of page %d\n", pgn);
+      exit(1);
+    }
+  }
+
+  return &(*tbl)[pgn & (PAGING_PTBL_NR - 1)];
+}
+
+#ifdef MM_HUGEPAGE
+/*
+ * vmap_huge_page - map a huge page on contiguous MEMRAM frames
+ * @caller : process call
+ * @hpgn   : first page, aligned to PAGING_HUGE_NR
+ *
+ * Return -1 when MEMRAM has no aligned run of free frames left.
+ */
+static int vmap_huge_page(struct pcb_t *caller, int hpgn)
+{
+  struct mm_struct *mm = caller->mm;
+  int fpn, it;
+
+  if (MEMPHY_get_freefp_range(caller->mram, PAGING_HUGE_NR, &fpn) < 0)
+    return -1;
+
+  for (it = 0; it < PAGING_HUGE_NR; it++)
+  {
+    pte_set_fpn(&PAGING_PTE(mm, hpgn + it), fpn + it);
+    SETBIT(PAGING_PTE(mm, hpgn + it), PAGING_PTE_HUGE_MASK);
+    pte_changed(mm, hpgn + it);
+    MEMPHY_put_usedfp(caller->mram, fpn + it);
+  }
+
+  /* One FIFO node for the whole huge page */
+  enlist_pgn_node(&mm->fifo_pgn, hpgn);
+
+  return 0;
+}
+#endif
 
 /* 
  * vmap_page_range - map a range of page at aligned address
@@ -97,28 +181,28 @@ int vmap_page_range(struct pcb_t *caller,           // process call
 
   while (fpit != NULL)
   {
-    pte_set_fpn(&caller->mm->pgd[pgn + pgit], fpit->fpn);
+    pte_set_fpn(&PAGING_PTE(caller->mm, pgn + pgit), fpit->fpn);
+    pte_changed(caller->mm, pgn + pgit);
     frames = frames->fp_next;
     free(fpit);
     fpit = frames;
-    pgit++;
 
     // Tracking for later page replacement activities (if needed)
     // Enqueue new usage page
     enlist_pgn_node(&caller->mm->fifo_pgn, pgn + pgit);
+    pgit++;
   }
 
+  /* Pages mapped straight to swap are not online, they are enlisted
+   * when faulted in */
   while (fpit_swp != NULL)
   {
-    pte_set_swap(&caller->mm->pgd[pgn + pgit], 0, fpit_swp->fpn);
+    pte_set_swap(&PAGING_PTE(caller->mm, pgn + pgit), fpit_swp->swptyp, fpit_swp->fpn);
+    pte_changed(caller->mm, pgn + pgit);
     frm_lst_swap = frm_lst_swap->fp_next;
     free(fpit_swp);
     fpit_swp = frm_lst_swap;
     pgit++;
-
-    // Tracking for later page replacement activities (if needed)
-    // Enqueue new usage page
-    enlist_pgn_node(&caller->mm->fifo_pgn, pgn + pgit);
   }
 
   /* =============== */
@@ -133,7 +217,7 @@ int vmap_page_range(struct pcb_t *caller,           // process call
     for (pgit = 0; pgit < pgnum; ++pgit) {
       // caller->mm->pgd[PAGING_PGN(addr + pgit*PAGING_PAGESZ)] = fpit->fpn;
       int temp_addr = addr + pgit * PAGING_PAGESZ;
-      pte_set_fpn(&caller->mm->pgd[PAGING_PGN(temp_addr)], fpit->fpn);
+      pte_set_fpn(&PAGING_PTE(caller->mm, PAGING_PGN(temp_addr)), fpit->fpn);
 
       frames = frames->fp_next;
       free(fpit);
@@ -157,7 +241,7 @@ int vmap_page_range(struct pcb_t *caller,           // process call
 int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struct **frm_lst, struct framephy_struct **frm_lst_swap)
 {
   /* TODO */
-  int pgit, fpn;
+  int pgit, fpn, swptyp;
   // struct framephy_struct *newfp_str;
   int flag_half_in_ram = 0, flag_half_in_swap = 0;
 
@@ -177,17 +261,18 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
     }
     else
     { // ERROR CODE of obtaining somes but not enough frames
-      if (MEMPHY_get_freefp(caller->active_mswp, &fpn) == 0)
+      if (swap_get_freefp(0, &swptyp, &fpn) == 0)
       {
         flag_half_in_swap = 1;
 
         struct framephy_struct *node = malloc(sizeof(struct framephy_struct));
         node->fpn = fpn;
+        node->swptyp = swptyp;
         node->owner = caller->mm;
         node->fp_next = *frm_lst_swap;
         (*frm_lst_swap) = node;
 
-        MEMPHY_put_usedfp(caller->active_mswp, fpn);
+        MEMPHY_put_usedfp(swap_dev(swptyp), fpn);
       }
       else
       {
@@ -200,15 +285,14 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
 }
 
 /*
- * vm_map_ram - do the mapping all vm are to ram storage device
+ * vm_map_ram_pages - map a range of base pages to MEMRAM, or to MEMSWP
+ *                    once MEMRAM is exhausted
  * @caller    : caller
- * @astart    : vm area start
- * @aend      : vm area end
  * @mapstart  : start mapping point
  * @incpgnum  : number of mapped page
  * @ret_rg    : returned region
  */
-int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg)
+static int vm_map_ram_pages(struct pcb_t *caller, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg)
 {
   struct framephy_struct *frm_lst = NULL;
   struct framephy_struct *frm_lst_swap = NULL;
@@ -242,6 +326,47 @@ int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int inc
   return 0;
 }
 
+/*
+ * vm_map_ram - do the mapping all vm are to ram storage device
+ * @caller    : caller
+ * @astart    : vm area start
+ * @aend      : vm area end
+ * @mapstart  : start mapping point
+ * @incpgnum  : number of mapped page
+ * @ret_rg    : returned region
+ */
+int vm_map_ram(struct pcb_t *caller, int astart, int aend, int mapstart, int incpgnum, struct vm_rg_struct *ret_rg)
+{
+#ifdef MM_HUGEPAGE
+  /* Aligned runs of PAGING_HUGE_NR pages are mapped as huge pages while
+   * MEMRAM has contiguous frames, the rest with base pages */
+  int pgn = PAGING_PGN(mapstart);
+  int endpgn = pgn + incpgnum;
+  int hpgn = PAGING_HUGE_PGN(pgn + PAGING_HUGE_NR - 1);
+
+  if (hpgn + PAGING_HUGE_NR <= endpgn)
+  {
+    if (hpgn > pgn && vm_map_ram_pages(caller, mapstart, hpgn - pgn, ret_rg) < 0)
+      return -1;
+
+    for (; hpgn + PAGING_HUGE_NR <= endpgn; hpgn += PAGING_HUGE_NR)
+    {
+      if (vmap_huge_page(caller, hpgn) == 0)
+        continue;
+      if (vm_map_ram_pages(caller, hpgn << PAGING_PAGE_SHIFT, PAGING_HUGE_NR, ret_rg) < 0)
+        return -1;
+    }
+
+    if (hpgn == endpgn)
+      return 0;
+    mapstart = hpgn << PAGING_PAGE_SHIFT;
+    incpgnum = endpgn - hpgn;
+  }
+#endif
+
+  return vm_map_ram_pages(caller, mapstart, incpgnum, ret_rg);
+}
+
 /* Swap copy content page from source frame to destination frame 
  * @mpsrc  : source memphy
  * @srcfpn : source physical page number (FPN)
@@ -252,11 +377,11 @@ int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
                 struct memphy_struct *mpdst, int dstfpn)
 {
   int cellidx;
-  int addrsrc,addrdst;
+  addr_t addrsrc,addrdst;
   for(cellidx = 0; cellidx < PAGING_PAGESZ; cellidx++)
   {
-    addrsrc = srcfpn * PAGING_PAGESZ + cellidx;
-    addrdst = dstfpn * PAGING_PAGESZ + cellidx;
+    addrsrc = PAGING_FRAME_ADDR(srcfpn) + cellidx;
+    addrdst = PAGING_FRAME_ADDR(dstfpn) + cellidx;
 
     BYTE data;
     MEMPHY_read(mpsrc, addrsrc, &data);
@@ -275,7 +400,11 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
 {
   struct vm_area_struct * vma = malloc(sizeof(struct vm_area_struct));
 
-  mm->pgd = malloc(PAGING_MAX_PGN*sizeof(uint32_t));
+  /* PTE tables come with the first access, see pte_alloc */
+  mm->pgd = calloc(PAGING_PGD_NR, sizeof(pte_t *));
+  mm->pgd_chg_list = NULL;
+  mm->nr_pgd_chg = 0;
+  mm->max_pgd_chg = 0;
 
   /* By default the owner comes with at least one vma */
   vma->vm_id = 1;
@@ -283,12 +412,18 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller)
   vma->vm_end = vma->vm_start;
   vma->sbrk = vma->vm_start;
   struct vm_rg_struct *first_rg = init_vm_rg(vma->vm_start, vma->vm_end);
+  vma->vm_freerg_list = NULL;
   enlist_vm_rg_node(&vma->vm_freerg_list, first_rg);
 
   vma->vm_next = NULL;
   vma->vm_mm = mm; /*point back to vma owner */
 
   mm->mmap = vma;
+  mm->fifo_pgn = NULL;
+  mm->kswapd = NULL;
+  memset(&mm->swap_ra, 0, sizeof(struct swap_ra_struct));
+  mm->swap_ra.last_pgn = mm->swap_ra.next_pgn = -2;
+  pthread_mutex_init(&mm->lock, NULL);
 
   return 0;
 }
@@ -323,23 +458,22 @@ int enlist_pgn_node(struct pgn_t **plist, int pgn)
   return 0;
 }
 
-/* delist pgn_t* fifo and return the pgn, if pgnlisr empty => -1 */
-int delist_pgn_node(struct pgn_t **pgnlist)
+/* delist the node of pgn from a pgn_t* fifo, if not listed => -1 */
+int delist_pgn_node(struct pgn_t **pgnlist, int pgn)
 {
-  struct pgn_t *pnode = *pgnlist;
+  struct pgn_t **it = pgnlist;
 
-  if ((*pgnlist) == NULL)
-    return -1;
-
-  while (pnode != NULL && pnode->pg_next != NULL)
-    pnode = pnode->pg_next;
+  while (*it != NULL && (*it)->pgn != pgn)
+    it = &(*it)->pg_next;
 
-  //  *pgnlist = (*pgnlist)->pg_next;
-  int pgn = pnode->pgn;
+  if (*it == NULL)
+    return -1;
 
+  struct pgn_t *pnode = *it;
+  *it = pnode->pg_next;
   free(pnode);
 
-  return pgn;
+  return 0;
 }
 
 int print_list_fp(struct framephy_struct *ifp)
@@ -404,6 +538,80 @@ int print_list_pgn(struct pgn_t *ip)
    return 0;
 }
 
+int print_swap_ra(struct mm_struct *mm)
+{
+   struct swap_ra_struct *ra = &mm->swap_ra;
+
+   printf("print_swap_ra: faults %lu readahead %lu hit %lu wasted %lu",
+          ra->nr_fault, ra->nr_issued, ra->nr_hit, ra->nr_wasted);
+   if (ra->nr_issued > 0)
+     printf(" hit-rate %lu%%", ra->nr_hit * 100 / ra->nr_issued);
+   printf("\n");
+   return 0;
+}
+
+/*
+ * pte_changed - note a PTE update for the next print_pgtbl_delta
+ * @mm: owner mm, its page table lock held
+ * @pgn: page number of the updated PTE
+ */
+int pte_changed(struct mm_struct *mm, int pgn)
+{
+  if (pgn < 0 || pgn >= PAGING_MAX_PGN)
+    return -1;
+
+  if (!(PAGING_PTE_LOOKUP(mm, pgn) & PAGING_PTE_CHANGED_MASK))
+  {
+    if (mm->nr_pgd_chg == mm->max_pgd_chg)
+    {
+      mm->max_pgd_chg = mm->max_pgd_chg ? 2 * mm->max_pgd_chg : PAGING_PTBL_NR;
+      mm->pgd_chg_list = realloc(mm->pgd_chg_list, mm->max_pgd_chg * sizeof(int));
+    }
+    SETBIT(PAGING_PTE(mm, pgn), PAGING_PTE_CHANGED_MASK);
+    mm->pgd_chg_list[mm->nr_pgd_chg++] = pgn;
+  }
+
+  return 0;
+}
+
+/*
+ * print_pgtbl_delta - print the PTEs changed since the last call
+ * @caller: owner process
+ *
+ * With PAGETBL_DUMP_FULL the whole table is printed as print_pgtbl
+ * does, the change set is still consumed.
+ */
+int print_pgtbl_delta(struct pcb_t *caller)
+{
+  struct mm_struct *mm;
+  int it;
+
+  if (caller == NULL) {printf("NULL caller\n"); return -1;}
+  mm = caller->mm;
+
+#ifdef PAGETBL_DUMP_FULL
+  print_pgtbl(caller, 0, -1);
+#endif
+
+  pthread_mutex_lock(&mm->lock);
+#ifndef PAGETBL_DUMP_FULL
+  printf("print_pgtbl_delta: %d changed\n", mm->nr_pgd_chg);
+#endif
+  for (it = 0; it < mm->nr_pgd_chg; it++)
+  {
+    int pgn = mm->pgd_chg_list[it];
+#ifndef PAGETBL_DUMP_FULL
+    printf("%08ld: %016llx\n", pgn * sizeof(pte_t),
+           (unsigned long long)(PAGING_PTE_LOOKUP(mm, pgn) & ~PAGING_PTE_CHANGED_MASK));
+#endif
+    CLRBIT(PAGING_PTE(mm, pgn), PAGING_PTE_CHANGED_MASK);
+  }
+  mm->nr_pgd_chg = 0;
+  pthread_mutex_unlock(&mm->lock);
+
+  return 0;
+}
+
 int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
 {
   int pgn_start,pgn_end;
@@ -424,7 +632,8 @@ int print_pgtbl(struct pcb_t *caller, uint32_t start, uint32_t end)
 
   for(pgit = pgn_start; pgit < pgn_end; pgit++)
   {
-     printf("%08ld: %08x\n", pgit * sizeof(uint32_t), caller->mm->pgd[pgit]);
+     printf("%08ld: %016llx\n", pgit * sizeof(pte_t),
+            (unsigned long long)(PAGING_PTE_LOOKUP(caller->mm, pgit) & ~PAGING_PTE_CHANGED_MASK));
   }
 
   return 0;
@@ -4,23 +4,40 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "mem.h"
+#include "trace.h"
+#include "lockprof.h"
 
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <ctype.h>
 #include <stdlib.h>
+#include <inttypes.h>
+#ifdef OS_STATS
+#include <time.h>
+#include <sys/resource.h>
+#endif
 
 static int time_slot;
 static int num_cpus;
+static int cpu_ips = 1; /* Instructions a CPU executes per time slot */
 static int done = 0;
+#ifdef MM_KSWAPD
+static int cpus_done = 0; /* Every CPU thread has exited */
+#endif
+static int mem_paging = 0; /* The memory backend needs the MEMPHY devices */
+#ifdef OS_STATS
+static uint64_t nr_insns = 0; /* Instructions run by all CPUs */
+#endif
 
 #ifdef CPU_TLB
 static int tlbsz;
 #endif
 
 #ifdef MM_PAGING
-static int memramsz;
-static int memswpsz[PAGING_MAX_MMSWP];
+static addr_t memramsz = 0x100000;
+static addr_t memswpsz[PAGING_MAX_MMSWP] = { 0x1000000 };
 
 struct mmpaging_ld_args {
 	/* A dispatched argument struct to compact many-fields passing to loader */
@@ -30,25 +47,30 @@ struct mmpaging_ld_args {
 	struct memphy_struct *active_mswp;
 	struct timer_id_t  *timer_id;
 };
-#endif
 
-static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
-#ifdef MLQ_SCHED
-	unsigned long * prio;
+#ifdef MM_KSWAPD
+struct kswapd_args {
+	struct memphy_struct *mram;
+	struct timer_id_t *timer_id;
+};
+#endif
 #endif
-} ld_processes;
+
+/* Arrival records are streamed from the config file by the prefetch
+ * worker, see ld_read_record() */
+static FILE * cfg_file;
 int num_processes;
 
 struct cpu_args {
 	struct timer_id_t * timer_id;
 	int id;
+	int ips;
 };
 
 static void * cpu_routine(void * args) {
 	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
 	int id = ((struct cpu_args*)args)->id;
+	int ips = ((struct cpu_args*)args)->ips;
 	/* Check for new process in ready queue */
 	int time_left = 0;
 	struct pcb_t * proc = NULL;
@@ -58,7 +80,7 @@ static void * cpu_routine(void * args) {
 			/* No process is running, the we load new process from
 		 	* ready queue */
 			proc = get_proc();
-			if (proc == NULL) {
+			if (proc == NULL && !done) {
                            next_slot(timer_id);
                            continue; /* First load failed. skip dummy load */
                         }
@@ -66,6 +88,24 @@ static void * cpu_routine(void * args) {
 			/* The porcess has finish it job */
 			printf("\tCPU %d: Processed %2d has finished\n",
 				id ,proc->pid);
+#ifdef OS_TRACE
+			trace_run_end(id, "finish");
+#endif
+#ifdef MM_PAGING
+			if (proc->mm != NULL) {
+				kswapd_unregister(proc);
+#if defined(MM_SWAP_RA) && defined(MMDBG)
+				print_swap_ra(proc->mm);
+#endif
+#ifdef MM_ZSWAP
+				zswap_release(proc->mm);
+#endif
+				free_pcb_memph(proc);
+				free(proc->mm);
+			}
+#endif
+			code_put(proc->code);
+			free(proc->page_table);
 			free(proc);
 			proc = get_proc();
 			time_left = 0;
@@ -73,6 +113,9 @@ static void * cpu_routine(void * args) {
 			/* The process has done its job in current time slot */
 			printf("\tCPU %d: Put process %2d to run queue\n",
 				id, proc->pid);
+#ifdef OS_TRACE
+			trace_run_end(id, "put");
+#endif
 			put_proc(proc);
 			proc = get_proc();
 		}
@@ -90,18 +133,149 @@ static void * cpu_routine(void * args) {
 		}else if (time_left == 0) {
 			printf("\tCPU %d: Dispatched process %2d\n",
 				id, proc->pid);
-			time_left = time_slot;
+#ifdef OS_TRACE
+			trace_run_begin(id, proc);
+#endif
+			time_left = time_slot * ips;
 		}
 		
-		/* Run current process */
-		run(proc);
-		time_left--;
+		/* Run current process, up to ips instructions this slot */
+		int executed = run_burst(proc, time_left < ips ? time_left : ips);
+		time_left -= executed;
+#ifdef OS_STATS
+		__atomic_add_fetch(&nr_insns, executed, __ATOMIC_RELAXED);
+#endif
 		next_slot(timer_id);
 	}
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+/* Programs are parsed ahead of their start time by a prefetch worker
+ * and handed to the loader in arrival order through a bounded ring */
+#define LD_PREFETCH_DEPTH	16
+
+struct ld_item {
+	struct pcb_t * proc;
+	unsigned long start_time;
+	const char * path;
+};
+
+static struct {
+	struct ld_item item[LD_PREFETCH_DEPTH];
+	int head, count;
+	int eof; /* No more record in the config */
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty, not_full;
+} ld_ring = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.not_empty = PTHREAD_COND_INITIALIZER,
+	.not_full = PTHREAD_COND_INITIALIZER,
+};
+
+/* Program paths, interned so that a config launching the same
+ * programs many times keeps one copy of each path */
+#define LD_PATH_HASHSZ	256
+
+struct ld_path {
+	char * path;
+	struct ld_path * next;
+};
+
+static struct ld_path * ld_paths[LD_PATH_HASHSZ];
+
+static const char * ld_intern(const char * name) {
+	char path[256];
+	unsigned int h = 0;
+	const char * c;
+	struct ld_path * it;
+
+	snprintf(path, sizeof(path), "input/proc/%s", name);
+	for (c = path; *c; c++)
+		h = h * 31 + (unsigned char)*c;
+	h %= LD_PATH_HASHSZ;
+
+	for (it = ld_paths[h]; it != NULL; it = it->next)
+		if (!strcmp(it->path, path))
+			return it->path;
+
+	it = malloc(sizeof(struct ld_path));
+	it->path = strdup(path);
+	it->next = ld_paths[h];
+	ld_paths[h] = it;
+	return it->path;
+}
+
+/* Read the next arrival record, return 0 on success */
+static int ld_read_record(unsigned long * start_time, const char ** path,
+		unsigned long * prio) {
+	char proc[100];
+#ifdef MLQ_SCHED
+	if (fscanf(cfg_file, "%lu %99s %lu\n", start_time, proc, prio) != 3)
+		return -1;
+#else
+	if (fscanf(cfg_file, "%lu %99s\n", start_time, proc) != 2)
+		return -1;
+	*prio = 0;
+#endif
+	*path = ld_intern(proc);
+	return 0;
+}
+
+static void * ld_prefetch_routine(void * args) {
+	unsigned long start_time, prio;
+	const char * path;
+	int i;
+	for (i = 0; i < num_processes; i++) {
+		if (ld_read_record(&start_time, &path, &prio) != 0) {
+			printf("Missing process %d in configure file\n", i);
+			break;
+		}
+		struct pcb_t * proc = load(path);
+#ifdef MLQ_SCHED
+		proc->prio = prio;
+#endif
+		pthread_mutex_lock(&ld_ring.lock);
+		while (ld_ring.count == LD_PREFETCH_DEPTH)
+			pthread_cond_wait(&ld_ring.not_full, &ld_ring.lock);
+		struct ld_item * it =
+			&ld_ring.item[(ld_ring.head + ld_ring.count) % LD_PREFETCH_DEPTH];
+		it->proc = proc;
+		it->start_time = start_time;
+		it->path = path;
+		ld_ring.count++;
+		pthread_cond_signal(&ld_ring.not_empty);
+		pthread_mutex_unlock(&ld_ring.lock);
+	}
+	fclose(cfg_file);
+
+	pthread_mutex_lock(&ld_ring.lock);
+	ld_ring.eof = 1;
+	pthread_cond_signal(&ld_ring.not_empty);
+	pthread_mutex_unlock(&ld_ring.lock);
+	pthread_exit(NULL);
+}
+
+/* Next process in arrival order, wait for the worker if it is late.
+ * NULL once every process of the config went through */
+static struct ld_item * ld_peek(void) {
+	struct ld_item * it;
+	pthread_mutex_lock(&ld_ring.lock);
+	while (ld_ring.count == 0 && !ld_ring.eof)
+		pthread_cond_wait(&ld_ring.not_empty, &ld_ring.lock);
+	it = (ld_ring.count > 0) ? &ld_ring.item[ld_ring.head] : NULL;
+	pthread_mutex_unlock(&ld_ring.lock);
+	return it;
+}
+
+static void ld_pop(void) {
+	pthread_mutex_lock(&ld_ring.lock);
+	ld_ring.head = (ld_ring.head + 1) % LD_PREFETCH_DEPTH;
+	ld_ring.count--;
+	pthread_cond_signal(&ld_ring.not_full);
+	pthread_mutex_unlock(&ld_ring.lock);
+}
+
 static void * ld_routine(void * args) {
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
@@ -111,89 +285,170 @@ static void * ld_routine(void * args) {
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
-	int i = 0;
+	pthread_t prefetch;
+	struct ld_item * it;
 	printf("ld_routine\n");
-	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
-#ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
-#endif
-		while (current_time() < ld_processes.start_time[i]) {
+	pthread_create(&prefetch, NULL, ld_prefetch_routine, NULL);
+	while ((it = ld_peek()) != NULL) {
+		if (current_time() < it->start_time) {
 			next_slot(timer_id);
+			continue;
 		}
+
+		/* Admit every process whose start time has passed */
+		struct pcb_t * proc = it->proc;
 #ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
-#endif
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
+		if (mem_paging) {
+			proc->mm = malloc(sizeof(struct mm_struct));
+			init_mm(proc->mm, proc);
+			proc->mram = mram;
+			proc->mswp = mswp;
+			proc->active_mswp = active_mswp;
+			kswapd_register(proc);
+		}
+#endif
+#ifdef MLQ_SCHED
+		printf("\tLoaded a process at %s, PID: %d PRIO: %d\n",
+			it->path, proc->pid, proc->prio);
+#else
+		printf("\tLoaded a process at %s, PID: %d\n",
+			it->path, proc->pid);
+#endif
+#ifdef OS_TRACE
+		trace_name(TRACE_PID_PROC, proc->pid, "P%u %s", proc->pid, it->path);
+		trace_instant(TRACE_PID_OS, TRACE_TID_LOADER, "sched", "load",
+			"\"pid\":%u,\"path\":\"%s\"", proc->pid, it->path);
+#endif
 		add_proc(proc);
-		free(ld_processes.path[i]);
-		i++;
-		next_slot(timer_id);
+		ld_pop();
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
+	pthread_join(prefetch, NULL);
 	done = 1;
 	detach_event(timer_id);
 	pthread_exit(NULL);
 }
 
+#ifdef MM_KSWAPD
+static void * kswapd_routine(void * args) {
+	struct memphy_struct * mram = ((struct kswapd_args *)args)->mram;
+	struct timer_id_t * timer_id = ((struct kswapd_args *)args)->timer_id;
+
+	/* Keep MEMRAM above its watermarks while the CPUs run. A process
+	 * left registered by stopped CPUs must not keep kswapd alive */
+	while (!cpus_done) {
+#ifdef OS_TRACE
+		int nr = kswapd_balance(mram);
+		if (nr > 0)
+			trace_instant(TRACE_PID_OS, TRACE_TID_KSWAPD, "mm",
+				"reclaim", "\"frames\":%d", nr);
+#else
+		kswapd_balance(mram);
+#endif
+		next_slot(timer_id);
+	}
+	detach_event(timer_id);
+	pthread_exit(NULL);
+}
+#endif
+
+/* A memory line holds only sizes, an arrival record names a program */
+static int is_mem_line(const char * line) {
+	int nr = 0;
+	while (*line != '\0') {
+		if (*line >= '0' && *line <= '9')
+			nr++;
+		else if (*line != ' ' && *line != '\t' &&
+		         *line != '\r' && *line != '\n')
+			return 0;
+		line++;
+	}
+	return nr > 0;
+}
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
 		printf("Cannot find configure file at %s\n", path);
 		exit(1);
 	}
-	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#ifdef MM_PAGING
-	int sit;
-#ifdef MM_FIXED_MEMSZ
-	/* We provide here a back compatible with legacy OS simulatiom config file
-	 * In which, it have no addition config line for Mema, keep only one line
-	 * for legacy info 
-	 *  [time slice] [N = Number of CPU] [M = Number of Processes to be run]
+	/* [time slice] [N = Number of CPU] [M = Number of Processes to be run]
+	 * optionally followed, in any order, by [instructions per time slot],
+	 * default 1, and [memory backend]: tlb, paging or legacy
 	 */
-	memramsz    =  0x100000;
-	memswpsz[0] = 0x1000000;
-	for(sit = 1; sit < PAGING_MAX_MMSWP; sit++)
-		memswpsz[sit] = 0;
-#else
+	char line[256], backend[16] = "", tok[16];
+	int pos, len, has_ips = 0;
+	if (fgets(line, sizeof(line), file) == NULL ||
+	    sscanf(line, "%d %d %d%n", &time_slot, &num_cpus,
+	           &num_processes, &pos) < 3) {
+		printf("Invalid configure file at %s\n", path);
+		exit(1);
+	}
+	/* Optional tokens in any order, a number is the ips, a word the
+	 * backend. Anything else is rejected rather than ignored */
+	while (sscanf(line + pos, "%15s%n", tok, &len) == 1) {
+		pos += len;
+		if (isdigit((unsigned char)tok[0]) && !has_ips) {
+			cpu_ips = atoi(tok);
+			has_ips = 1;
+		} else if (isalpha((unsigned char)tok[0]) && backend[0] == '\0') {
+			strcpy(backend, tok);
+		} else {
+			printf("Unexpected '%s' in the first line of %s\n", tok, path);
+			exit(1);
+		}
+	}
+	if (cpu_ips < 1)
+		cpu_ips = 1;
+
 	/* Read input config of memory size: MEMRAM and upto 4 MEMSWP (mem swap)
 	 * Format: (size=0 result non-used memswap, must have RAM and at least 1 SWAP)
-	 *        MEM_RAM_SZ MEM_SWP0_SZ MEM_SWP1_SZ MEM_SWP2_SZ MEM_SWP3_SZ
-	*/
-	fscanf(file, "%d\n", &memramsz);
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
-		fscanf(file, "%d", &(memswpsz[sit])); 
-
-	fscanf(file, "\n"); /* Final character */
+	 *        MEM_RAM_SZ MEM_SWP0_SZ MEM_SWP1_SZ MEM_SWP2_SZ MEM_SWP3_SZ [PAGE_SZ]
+	 * PAGE_SZ is optional, PAGING_PAGESZ_DEF by default
+	 * Legacy config files have no such line, a paging backend then runs
+	 * with the default sizes
+	 */
+	long records = ftell(file);
+	int has_mem = 0;
+	if (fgets(line, sizeof(line), file) != NULL && is_mem_line(line))
+		has_mem = 1;
+	else
+		fseek(file, records, SEEK_SET);
+#ifdef MM_PAGING
+#ifdef MM_FIXED_MEMSZ
+	/* Sizes are fixed, the memory line is skipped if any */
+	has_mem = 1;
+#else
+	int pagesz = PAGING_PAGESZ_DEF;
+	if (has_mem)
+		sscanf(line, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+		       " %" SCNu64 " %d", &memramsz, &memswpsz[0],
+		       &memswpsz[1], &memswpsz[2], &memswpsz[3], &pagesz);
+	if (paging_set_pagesz(pagesz) != 0) {
+		printf("Unsupported page size %d in %s\n", pagesz, path);
+		exit(1);
+	}
+	for (int it = -1; it < PAGING_MAX_MMSWP; it++) {
+		addr_t sz = (it < 0) ? memramsz : memswpsz[it];
+		if (sz >= PAGING_MEMPHY_MAXSZ) {
+			printf("Unsupported memory size %" PRIu64 " in %s\n", sz, path);
+			exit(1);
+		}
+	}
 #endif
 #endif
 
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
-	int i;
-	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
-#ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
-#endif
-		strcat(ld_processes.path[i], proc);
+	/* Memory backend, by default the most capable one the memory
+	 * config is meant for */
+	const struct mem_backend_t * mb = cpu_default_backend(has_mem);
+	if (backend[0] != '\0' && (mb = cpu_find_backend(backend)) == NULL) {
+		printf("Unknown memory backend %s in %s\n", backend, path);
+		exit(1);
 	}
+	cpu_set_backend(mb);
+	mem_paging = mb->paging;
+
+	/* Arrival records are left in the file for the loader */
+	cfg_file = file;
 }
 
 int main(int argc, char * argv[]) {
@@ -202,24 +457,45 @@ int main(int argc, char * argv[]) {
 		printf("Usage: os [path to configure file]\n");
 		return 1;
 	}
+#ifdef OS_STATS
+	struct timespec t_start, t_end;
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+#endif
 	char path[100];
 	path[0] = '\0';
 	strcat(path, "input/");
 	strcat(path, argv[1]);
 	read_config(path);
+	/* OS_QUIET in the environment keeps the run logging but drops
+	 * the memory access trace, for timing */
+	iodump_quiet = getenv("OS_QUIET") != NULL;
+#ifdef OS_TRACE
+	trace_open(TRACE_FILE);
+#endif
 
 	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
 	struct cpu_args * args =
 		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
 	pthread_t ld;
+#ifdef MM_KSWAPD
+	pthread_t kswapd;
+#endif
 	
 	/* Init timer */
 	int i;
 	for (i = 0; i < num_cpus; i++) {
 		args[i].timer_id = attach_event();
 		args[i].id = i;
+		args[i].ips = cpu_ips;
+#ifdef OS_TRACE
+		trace_name(TRACE_PID_OS, i, "CPU %d", i);
+#endif
 	}
 	struct timer_id_t * ld_event = attach_event();
+#ifdef MM_KSWAPD
+	/* kswapd only runs for a paging backend, no event to wait for else */
+	struct timer_id_t * kswapd_event = mem_paging ? attach_event() : NULL;
+#endif
 	start_timer();
 
 #ifdef MM_PAGING
@@ -229,14 +505,35 @@ int main(int argc, char * argv[]) {
 	struct memphy_struct mram;
 	struct memphy_struct mswp[PAGING_MAX_MMSWP];
 
-
+	if (mem_paging) {
 	/* Create MEM RAM */
 	init_memphy(&mram, memramsz, rdmflag);
 
 	/* Create all MEM SWAP */ 
 	int sit;
-	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++)
+	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++) {
+#ifdef MM_SWPFILE
+	       /* Sparse file backed swap, only touched frames cost memory */
+	       if (memswpsz[sit] > 0) {
+		       char swpfile[32];
+		       snprintf(swpfile, sizeof(swpfile), PAGING_SWPFILE_FMT, sit);
+		       init_memphy_file(&mswp[sit], memswpsz[sit], rdmflag, swpfile);
+		       continue;
+	       }
+#endif
 	       init_memphy(&mswp[sit], memswpsz[sit], rdmflag);
+	}
+
+	/* Spread swap slots over all non-empty MEMSWP */
+	init_swap(mswp, PAGING_MAX_MMSWP);
+
+#ifdef MM_ZSWAP
+	/* Compressed swap cache lives in MEMRAM, writes back to MEMSWP */
+	init_zswap(&mram);
+#endif
+	} else {
+		init_mem();
+	}
 
 	/* In Paging mode, it needs passing the system mem to each PCB through loader*/
 	struct mmpaging_ld_args *mm_ld_args = malloc(sizeof(struct mmpaging_ld_args));
@@ -245,6 +542,15 @@ int main(int argc, char * argv[]) {
 	mm_ld_args->mram = (struct memphy_struct *) &mram;
 	mm_ld_args->mswp = (struct memphy_struct**) &mswp;
 	mm_ld_args->active_mswp = (struct memphy_struct *)&mswp[0];
+
+#ifdef MM_KSWAPD
+	struct kswapd_args *kswapd_args = malloc(sizeof(struct kswapd_args));
+
+	kswapd_args->timer_id = kswapd_event;
+	kswapd_args->mram = (struct memphy_struct *) &mram;
+#endif
+#else
+	init_mem();
 #endif
 
 	/* Init scheduler */
@@ -253,6 +559,10 @@ int main(int argc, char * argv[]) {
 	/* Run CPU and loader */
 #ifdef MM_PAGING
 	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
+#ifdef MM_KSWAPD
+	if (mem_paging)
+		pthread_create(&kswapd, NULL, kswapd_routine, (void*)kswapd_args);
+#endif
 #else
 	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
 #endif
@@ -265,10 +575,43 @@ int main(int argc, char * argv[]) {
 	for (i = 0; i < num_cpus; i++) {
 		pthread_join(cpu[i], NULL);
 	}
+#ifdef MM_KSWAPD
+	cpus_done = 1;
+#endif
 	pthread_join(ld, NULL);
+#ifdef MM_KSWAPD
+	if (mem_paging)
+		pthread_join(kswapd, NULL);
+#endif
 
 	/* Stop timer */
 	stop_timer();
+#ifdef OS_TRACE
+	trace_close();
+#endif
+
+#if defined(MM_PAGING) && defined(MMDBG)
+	if (mem_paging)
+		print_swap();
+#endif
+#if defined(MM_ZSWAP) && defined(MMDBG)
+	if (mem_paging)
+		print_zswap();
+#endif
+#ifdef LOCK_PROF
+	lockprof_dump(stderr);
+#endif
+#ifdef OS_STATS
+	/* Run summary for tools/perf.sh, kept out of the stdout trace */
+	struct rusage usage;
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	getrusage(RUSAGE_SELF, &usage);
+	fprintf(stderr, "STATS slots=%lu insns=%lu wall_us=%lu maxrss_kb=%ld\n",
+		(unsigned long)current_time(), (unsigned long)nr_insns,
+		(unsigned long)((t_end.tv_sec - t_start.tv_sec) * 1000000L +
+		                (t_end.tv_nsec - t_start.tv_nsec) / 1000),
+		usage.ru_maxrss);
+#endif
 
 	return 0;
 
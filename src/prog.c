@@ -0,0 +1,177 @@
+
+#include "prog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define OPT_CALC	"calc"
+#define OPT_ALLOC	"alloc"
+#define OPT_FREE	"free"
+#define OPT_READ	"read"
+#define OPT_WRITE	"write"
+#define OPT_COPY	"copy"
+#define OPT_FILL	"fill"
+#define OPT_CMP		"cmp"
+
+static enum ins_opcode_t get_opcode(char * opt) {
+	if (!strcmp(opt, OPT_CALC)) {
+		return CALC;
+	}else if (!strcmp(opt, OPT_ALLOC)) {
+		return ALLOC;
+	}else if (!strcmp(opt, OPT_FREE)) {
+		return FREE;
+	}else if (!strcmp(opt, OPT_READ)) {
+		return READ;
+	}else if (!strcmp(opt, OPT_WRITE)) {
+		return WRITE;
+	}else if (!strcmp(opt, OPT_COPY)) {
+		return COPY;
+	}else if (!strcmp(opt, OPT_FILL)) {
+		return FILL;
+	}else if (!strcmp(opt, OPT_CMP)) {
+		return CMP;
+	}else{
+		printf("Opcode: %s\n", opt);
+		exit(1);
+	}
+}
+
+/* Parse a text program into a new code segment */
+static struct code_seg_t * prog_parse(FILE * file, uint32_t * priority) {
+	char opcode[10];
+	struct code_seg_t * code =
+		(struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	fscanf(file, "%u %u", priority, &code->size);
+	code->text = (struct inst_t*)calloc(
+		code->size, sizeof(struct inst_t)
+	);
+	code->refcnt = 1;
+	code->map = NULL;
+	code->map_len = 0;
+	uint32_t i = 0;
+	for (i = 0; i < code->size; i++) {
+		if (fscanf(file, "%9s", opcode) != 1) {
+			/* Fewer instructions than announced in the header */
+			code->size = i;
+			break;
+		}
+		code->text[i].opcode = get_opcode(opcode);
+		switch(code->text[i].opcode) {
+		case CALC:
+			break;
+		case ALLOC:
+			fscanf(
+				file,
+				"%u %u\n",
+				&code->text[i].arg_0,
+				&code->text[i].arg_1
+			);
+			break;
+		case FREE:
+			fscanf(file, "%u\n", &code->text[i].arg_0);
+			break;
+		case READ:
+		case WRITE:
+		case COPY:
+		case FILL:
+		case CMP:
+			fscanf(
+				file,
+				"%u %u %u\n",
+				&code->text[i].arg_0,
+				&code->text[i].arg_1,
+				&code->text[i].arg_2
+			);
+			break;	
+		default:
+			printf("Opcode: %s\n", opcode);
+			exit(1);
+		}
+	}
+	return code;
+}
+
+/* Map a compiled program, the instructions are used in place */
+static struct code_seg_t * prog_map(int fd, uint32_t * priority) {
+	struct prog_hdr_t hdr;
+	struct stat st;
+	void * map;
+
+	if (fstat(fd, &st) != 0 ||
+	    pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+	    hdr.version != PROG_VERSION ||
+	    (size_t)st.st_size < sizeof(hdr) + (size_t)hdr.size * sizeof(struct inst_t)) {
+		return NULL;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		return NULL;
+	}
+
+	struct code_seg_t * code =
+		(struct code_seg_t*)malloc(sizeof(struct code_seg_t));
+	*priority = hdr.priority;
+	code->size = hdr.size;
+	code->text = (struct inst_t*)((char*)map + sizeof(hdr));
+	code->handler = NULL;
+	code->refcnt = 1;
+	code->map = map;
+	code->map_len = st.st_size;
+	return code;
+}
+
+struct code_seg_t * prog_load(const char * path, uint32_t * priority) {
+	struct code_seg_t * code;
+	uint32_t magic = 0;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		return NULL;
+	}
+
+	/* pread, cpu.c has its own read() */
+	if (pread(fd, &magic, sizeof(magic), 0) == sizeof(magic) &&
+	    magic == PROG_MAGIC) {
+		code = prog_map(fd, priority);
+		close(fd);
+		return code;
+	}
+
+	FILE * file = fdopen(fd, "r");
+	if (file == NULL) {
+		close(fd);
+		return NULL;
+	}
+	code = prog_parse(file, priority);
+	fclose(file);
+	return code;
+}
+
+int prog_write(const char * path, struct code_seg_t * code, uint32_t priority) {
+	struct prog_hdr_t hdr = {PROG_MAGIC, PROG_VERSION, priority, code->size};
+	FILE * file;
+
+	if ((file = fopen(path, "wb")) == NULL) {
+		return -1;
+	}
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+	    fwrite(code->text, sizeof(struct inst_t), code->size, file) != code->size) {
+		fclose(file);
+		return -1;
+	}
+	return fclose(file);
+}
+
+void prog_release(struct code_seg_t * code) {
+	if (code->map != NULL) {
+		munmap(code->map, code->map_len);
+	}else{
+		free(code->text);
+	}
+	free(code);
+}
@@ -0,0 +1,36 @@
+/*
+ * Program compiler
+ *
+ *   progc <text program> <compiled program>
+ *
+ * Converts a program of input/proc/ to the binary format of prog.h,
+ * which the loader maps directly instead of parsing.
+ */
+
+#include "prog.h"
+#include <stdio.h>
+
+int main(int argc, char * argv[]) {
+	struct code_seg_t * code;
+	uint32_t priority;
+
+	if (argc != 3) {
+		printf("Usage: progc [text program] [compiled program]\n");
+		return 1;
+	}
+
+	if ((code = prog_load(argv[1], &priority)) == NULL) {
+		printf("Cannot read program at '%s'\n", argv[1]);
+		return 1;
+	}
+
+	if (prog_write(argv[2], code, priority) != 0) {
+		printf("Cannot write program at '%s'\n", argv[2]);
+		prog_release(code);
+		return 1;
+	}
+
+	printf("%s: %u instructions\n", argv[2], code->size);
+	prog_release(code);
+	return 0;
+}
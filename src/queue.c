@@ -10,7 +10,18 @@ int empty(struct queue_t * q) {
 void enqueue(struct queue_t *q, struct pcb_t *proc)
 {
 	/* TODO: put a new process to queue [q] */
-	q->proc[q->size] = proc;
+	if (q->size == q->cap) {
+		/* Grow and unwrap the ring, the oldest process goes first */
+		int cap = q->cap ? q->cap * 2 : MAX_QUEUE_SIZE;
+		struct pcb_t **procs = malloc(sizeof(struct pcb_t *) * cap);
+		for (int i = 0; i < q->size; i++)
+			procs[i] = q->proc[(q->head + i) % q->cap];
+		free(q->proc);
+		q->proc = procs;
+		q->cap = cap;
+		q->head = 0;
+	}
+	q->proc[(q->head + q->size) % q->cap] = proc;
 	q->size += 1;
 }
 
@@ -22,15 +33,11 @@ struct pcb_t *dequeue(struct queue_t *q)
 	if (empty(q))
 		return NULL;
 
-	// If the queue is not empty ...
-	struct pcb_t *temp = q->proc[0];
-
-	for (int i = 0; i < q->size - 1; i++)
-	{
-		q->proc[i] = q->proc[i + 1];
-	}
+	// If the queue is not empty, the oldest process is at the head
+	struct pcb_t *temp = q->proc[q->head];
 
-	q->proc[q->size - 1] = NULL;
+	q->proc[q->head] = NULL;
+	q->head = (q->head + 1) % q->cap;
 	q->size -= 1;
 
 	return temp;
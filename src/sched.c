@@ -1,6 +1,7 @@
 
 #include "queue.h"
 #include "sched.h"
+#include "lockprof.h"
 #include <pthread.h>
 
 #include <stdlib.h>
@@ -31,12 +32,15 @@ void init_scheduler(void)
 
 	for (i = 0; i < MAX_PRIO; i++)
 	{
+		mlq_ready_queue[i].head = 0;
 		mlq_ready_queue[i].size = 0;
 		mlq_ready_queue[i].slot = MAX_PRIO - i;
 	}
 
 #endif
+	ready_queue.head = 0;
 	ready_queue.size = 0;
+	run_queue.head = 0;
 	run_queue.size = 0;
 	pthread_mutex_init(&queue_lock, NULL);
 }
@@ -69,34 +73,34 @@ struct pcb_t *get_mlq_proc(void)
 	int prio_select = -1;
 	for (prio_select = 0; prio_select < MAX_PRIO; ++prio_select)
 	{
-		pthread_mutex_lock(&queue_lock);
+		MUTEX_LOCK(&queue_lock);
 		int flag_empty = empty(&mlq_ready_queue[prio_select]);
 		if (flag_empty)
 		{
 			if (prio_select == MAX_PRIO - 1)
 				resetSlot();
-			pthread_mutex_unlock(&queue_lock);
+			MUTEX_UNLOCK(&queue_lock);
 			continue;
 		}
 		else
-			pthread_mutex_unlock(&queue_lock);
+			MUTEX_UNLOCK(&queue_lock);
 
 		if (mlq_ready_queue[prio_select].slot > 0)
 		{
-			pthread_mutex_lock(&queue_lock);
+			MUTEX_LOCK(&queue_lock);
 			proc = dequeue(&mlq_ready_queue[prio_select]);
 			mlq_ready_queue[prio_select].slot--;
-			pthread_mutex_unlock(&queue_lock);
+			MUTEX_UNLOCK(&queue_lock);
 			break;
 		}
 		else
 		{
 			if (prio_select == MAX_PRIO - 1)
 			{
-				pthread_mutex_lock(&queue_lock);
+				MUTEX_LOCK(&queue_lock);
 				resetSlot();
 				prio_select = 0;
-				pthread_mutex_unlock(&queue_lock);
+				MUTEX_UNLOCK(&queue_lock);
 			}
 		}
 	}
@@ -105,15 +109,15 @@ struct pcb_t *get_mlq_proc(void)
 }
 
 void put_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
+	MUTEX_LOCK(&queue_lock);
 	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);
+	MUTEX_UNLOCK(&queue_lock);
 }
 
 void add_mlq_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
+	MUTEX_LOCK(&queue_lock);
 	enqueue(&mlq_ready_queue[proc->prio], proc);
-	pthread_mutex_unlock(&queue_lock);	
+	MUTEX_UNLOCK(&queue_lock);	
 }
 
 struct pcb_t * get_proc(void) {
@@ -133,21 +137,21 @@ struct pcb_t * get_proc(void) {
 	/*TODO: get a process from [ready_queue].
 	 * Remember to use lock to protect the queue.
 	 * */
-	pthread_mutex_lock(&queue_lock);
+	MUTEX_LOCK(&queue_lock);
 	proc = dequeue(&ready_queue);
-	pthread_mutex_unlock(&queue_lock);
+	MUTEX_UNLOCK(&queue_lock);
 	return proc;
 }
 
 void put_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
+	MUTEX_LOCK(&queue_lock);
 	enqueue(&run_queue, proc);
-	pthread_mutex_unlock(&queue_lock);
+	MUTEX_UNLOCK(&queue_lock);
 }
 
 void add_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
+	MUTEX_LOCK(&queue_lock);
 	enqueue(&ready_queue, proc);
-	pthread_mutex_unlock(&queue_lock);	
+	MUTEX_UNLOCK(&queue_lock);	
 }
 #endif
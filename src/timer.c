@@ -129,6 +129,9 @@ void stop_timer() {
 		pthread_mutex_destroy(&temp->id.timer_lock);
 		free(temp);
 	}
+	/* Allow the timer to be started again */
+	timer_started = 0;
+	timer_stop = 0;
 }
 
 
@@ -0,0 +1,103 @@
+
+#include "trace.h"
+#include "timer.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <pthread.h>
+
+static FILE * trace_file = NULL;
+static int trace_nr = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Start a new event, caller holds trace_lock */
+static void trace_head(char ph, int pid, int tid, uint64_t ts) {
+	fprintf(trace_file, "%s{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%lu",
+		trace_nr++ ? ",\n" : "", ph, pid, tid, (unsigned long)ts);
+}
+
+int trace_open(const char * path) {
+	if ((trace_file = fopen(path, "w")) == NULL) {
+		printf("Cannot create trace file at %s\n", path);
+		return -1;
+	}
+	fprintf(trace_file, "[\n");
+	trace_nr = 0;
+	trace_name(TRACE_PID_OS, -1, "os");
+	trace_name(TRACE_PID_PROC, -1, "processes");
+	trace_name(TRACE_PID_OS, TRACE_TID_LOADER, "loader");
+	trace_name(TRACE_PID_OS, TRACE_TID_KSWAPD, "kswapd");
+	return 0;
+}
+
+void trace_close(void) {
+	if (trace_file == NULL)
+		return;
+	pthread_mutex_lock(&trace_lock);
+	fprintf(trace_file, "\n]\n");
+	fclose(trace_file);
+	trace_file = NULL;
+	pthread_mutex_unlock(&trace_lock);
+}
+
+/*trace_name - name a track, or a track group when tid is -1
+ *@pid: track group
+ *@tid: track
+ *@fmt: printf format of the name
+ */
+void trace_name(int pid, int tid, const char * fmt, ...) {
+	va_list ap;
+	if (trace_file == NULL)
+		return;
+	pthread_mutex_lock(&trace_lock);
+	trace_head('M', pid, tid < 0 ? 0 : tid, 0);
+	fprintf(trace_file, ",\"name\":\"%s\",\"args\":{\"name\":\"",
+		tid < 0 ? "process_name" : "thread_name");
+	va_start(ap, fmt);
+	vfprintf(trace_file, fmt, ap);
+	va_end(ap);
+	fprintf(trace_file, "\"}}");
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_run_begin(int cpu, struct pcb_t * proc) {
+	if (trace_file == NULL)
+		return;
+	pthread_mutex_lock(&trace_lock);
+	trace_head('B', TRACE_PID_OS, cpu, current_time() * TRACE_SLOT_US);
+#ifdef MLQ_SCHED
+	fprintf(trace_file, ",\"cat\":\"sched\",\"name\":\"P%u\","
+		"\"args\":{\"pid\":%u,\"prio\":%u,\"pc\":%u}}",
+		proc->pid, proc->pid, proc->prio, proc->pc);
+#else
+	fprintf(trace_file, ",\"cat\":\"sched\",\"name\":\"P%u\","
+		"\"args\":{\"pid\":%u,\"pc\":%u}}",
+		proc->pid, proc->pid, proc->pc);
+#endif
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_run_end(int cpu, const char * why) {
+	if (trace_file == NULL)
+		return;
+	pthread_mutex_lock(&trace_lock);
+	trace_head('E', TRACE_PID_OS, cpu, current_time() * TRACE_SLOT_US);
+	fprintf(trace_file, ",\"args\":{\"end\":\"%s\"}}", why);
+	pthread_mutex_unlock(&trace_lock);
+}
+
+void trace_instant(int pid, int tid, const char * cat, const char * name,
+		const char * args, ...) {
+	va_list ap;
+	if (trace_file == NULL)
+		return;
+	pthread_mutex_lock(&trace_lock);
+	trace_head('i', pid, tid, current_time() * TRACE_SLOT_US);
+	fprintf(trace_file, ",\"s\":\"t\",\"cat\":\"%s\",\"name\":\"%s\",\"args\":{",
+		cat, name);
+	va_start(ap, args);
+	vfprintf(trace_file, args, ap);
+	va_end(ap);
+	fprintf(trace_file, "}}");
+	pthread_mutex_unlock(&trace_lock);
+}
@@ -0,0 +1,240 @@
+/*
+ * Synthetic workload generator
+ *
+ *   wlgen [options] <name>
+ *
+ * Writes the config input/<name> and its programs input/proc/<name>_<k>
+ * in the formats read by os. The same seed always gives the same files.
+ *
+ *   -n procs       number of arrivals (default 100)
+ *   -P progs       number of distinct programs (default 8)
+ *   -c cpus        number of CPUs (default 4)
+ *   -t slot        time slice in slots (default 2)
+ *   -i ips         instructions per slot, omitted if 0 (default 0)
+ *   -a dist        arrivals: uniform, poisson or burst (default uniform)
+ *   -r rate        arrivals per slot (default 1)
+ *   -b size        arrivals per burst (default 16)
+ *   -p lo:hi       priority range (default 0:139)
+ *   -k skew        share in percent of arrivals at priority lo (default 0)
+ *   -l len         instructions per program (default 100)
+ *   -m c,a,r,w     CALC/ALLOC/READ/WRITE weights (default 4,1,2,2)
+ *   -w bytes       working set per process (default 4096)
+ *   -L percent     access locality, share of sequential accesses (default 80)
+ *   -R bytes       MEMRAM size (default 1048576)
+ *   -S bytes       MEMSWP0 size (default 16777216)
+ *   -g bytes       page size, omitted if 0 (default 0)
+ *   -s seed        random seed (default 1)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <math.h>
+
+#define WL_MAX_REGS	10	/* Region registers of a process */
+#define WL_ALLOC_MAX	256	/* Size bound of the extra allocations */
+
+static uint64_t wl_state;
+
+/* xorshift64*, portable and reproducible across libc */
+static uint64_t wl_rand(void) {
+	wl_state ^= wl_state >> 12;
+	wl_state ^= wl_state << 25;
+	wl_state ^= wl_state >> 27;
+	return wl_state * 0x2545F4914F6CDD1DULL;
+}
+
+static uint32_t wl_below(uint32_t n) {
+	return n ? (uint32_t)(wl_rand() % n) : 0;
+}
+
+static double wl_unit(void) {
+	return (wl_rand() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static struct {
+	int procs, progs, cpus, slot, ips;
+	const char * dist;
+	double rate;
+	int burst;
+	int prio_lo, prio_hi, skew;
+	int len;
+	int w_calc, w_alloc, w_read, w_write;
+	int wset, locality;
+	uint64_t ramsz, swpsz;
+	int pagesz;
+	uint64_t seed;
+} opt = {
+	100, 8, 4, 2, 0, "uniform", 1.0, 16, 0, 139, 0, 100,
+	4, 1, 2, 2, 4096, 80, 1048576, 16777216, 0, 1,
+};
+
+static int gen_program(const char * path) {
+	uint32_t regsz[WL_MAX_REGS];
+	int nregs = 0, it, cur = 0, off = 0;
+	int total = opt.w_calc + opt.w_alloc + opt.w_read + opt.w_write;
+	FILE * file;
+
+	if ((file = fopen(path, "w")) == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	/* The working set is spread over the first regions, allocated
+	 * up front so that every access targets a live region */
+	int initregs = (opt.wset + 1023) / 1024;
+	if (initregs > WL_MAX_REGS / 2)
+		initregs = WL_MAX_REGS / 2;
+	if (initregs < 1)
+		initregs = 1;
+
+	fprintf(file, "%d %d\n", opt.prio_lo, opt.len);
+	for (it = 0; it < opt.len; it++) {
+		uint32_t pick = wl_below(total);
+
+		if (nregs < initregs) {
+			regsz[nregs] = opt.wset / initregs;
+			if (regsz[nregs] == 0)
+				regsz[nregs] = 1;
+			fprintf(file, "alloc %u %d\n", regsz[nregs], nregs);
+			nregs++;
+			continue;
+		}
+
+		if (pick < (uint32_t)opt.w_calc) {
+			fprintf(file, "calc\n");
+			continue;
+		}
+		pick -= opt.w_calc;
+
+		if (pick < (uint32_t)opt.w_alloc) {
+			if (nregs < WL_MAX_REGS) {
+				regsz[nregs] = 1 + wl_below(WL_ALLOC_MAX);
+				fprintf(file, "alloc %u %d\n", regsz[nregs], nregs);
+				nregs++;
+			} else {
+				fprintf(file, "calc\n");
+			}
+			continue;
+		}
+		pick -= opt.w_alloc;
+
+		/* Next access: sequential from the previous one or random */
+		if ((int)wl_below(100) < opt.locality) {
+			if (++off >= (int)regsz[cur]) {
+				cur = (cur + 1) % nregs;
+				off = 0;
+			}
+		} else {
+			cur = wl_below(nregs);
+			off = wl_below(regsz[cur]);
+		}
+
+		if (pick < (uint32_t)opt.w_read)
+			fprintf(file, "read %d %d 0\n", cur, off);
+		else
+			fprintf(file, "write %u %d %d\n", wl_below(256), cur, off);
+	}
+
+	fclose(file);
+	return 0;
+}
+
+static void usage(void) {
+	printf("Usage: wlgen [-n procs] [-P progs] [-c cpus] [-t slot] [-i ips]\n"
+	       "             [-a uniform|poisson|burst] [-r rate] [-b size]\n"
+	       "             [-p lo:hi] [-k skew] [-l len] [-m c,a,r,w]\n"
+	       "             [-w bytes] [-L percent] [-R bytes] [-S bytes]\n"
+	       "             [-g bytes] [-s seed] <name>\n");
+}
+
+int main(int argc, char * argv[]) {
+	char path[256];
+	double clock = 0;
+	int c, it;
+	FILE * file;
+
+	while ((c = getopt(argc, argv, "n:P:c:t:i:a:r:b:p:k:l:m:w:L:R:S:g:s:h")) != -1) {
+		switch (c) {
+		case 'n': opt.procs = atoi(optarg); break;
+		case 'P': opt.progs = atoi(optarg); break;
+		case 'c': opt.cpus = atoi(optarg); break;
+		case 't': opt.slot = atoi(optarg); break;
+		case 'i': opt.ips = atoi(optarg); break;
+		case 'a': opt.dist = optarg; break;
+		case 'r': opt.rate = atof(optarg); break;
+		case 'b': opt.burst = atoi(optarg); break;
+		case 'p': sscanf(optarg, "%d:%d", &opt.prio_lo, &opt.prio_hi); break;
+		case 'k': opt.skew = atoi(optarg); break;
+		case 'l': opt.len = atoi(optarg); break;
+		case 'm': sscanf(optarg, "%d,%d,%d,%d", &opt.w_calc, &opt.w_alloc,
+		                 &opt.w_read, &opt.w_write); break;
+		case 'w': opt.wset = atoi(optarg); break;
+		case 'L': opt.locality = atoi(optarg); break;
+		case 'R': opt.ramsz = strtoull(optarg, NULL, 0); break;
+		case 'S': opt.swpsz = strtoull(optarg, NULL, 0); break;
+		case 'g': opt.pagesz = atoi(optarg); break;
+		case 's': opt.seed = strtoull(optarg, NULL, 0); break;
+		default: usage(); return 1;
+		}
+	}
+	if (optind != argc - 1 || opt.procs < 1 || opt.progs < 1 || opt.len < 1 ||
+	    opt.prio_lo > opt.prio_hi || opt.rate <= 0 ||
+	    opt.w_calc + opt.w_alloc + opt.w_read + opt.w_write <= 0) {
+		usage();
+		return 1;
+	}
+	wl_state = opt.seed ? opt.seed : 1;
+
+	for (it = 0; it < opt.progs; it++) {
+		snprintf(path, sizeof(path), "input/proc/%s_%d", argv[optind], it);
+		if (gen_program(path) != 0)
+			return 1;
+	}
+
+	snprintf(path, sizeof(path), "input/%s", argv[optind]);
+	if ((file = fopen(path, "w")) == NULL) {
+		perror(path);
+		return 1;
+	}
+
+	if (opt.ips > 0)
+		fprintf(file, "%d %d %d %d\n", opt.slot, opt.cpus, opt.procs, opt.ips);
+	else
+		fprintf(file, "%d %d %d\n", opt.slot, opt.cpus, opt.procs);
+	if (opt.pagesz > 0)
+		fprintf(file, "%" PRIu64 " %" PRIu64 " 0 0 0 %d\n", opt.ramsz,
+			opt.swpsz, opt.pagesz);
+	else
+		fprintf(file, "%" PRIu64 " %" PRIu64 " 0 0 0\n", opt.ramsz, opt.swpsz);
+
+	for (it = 0; it < opt.procs; it++) {
+		unsigned long start;
+		int prio;
+
+		if (!strcmp(opt.dist, "poisson")) {
+			/* Exponential inter-arrival times */
+			clock += -log(1.0 - wl_unit()) / opt.rate;
+			start = (unsigned long)clock;
+		} else if (!strcmp(opt.dist, "burst")) {
+			start = (unsigned long)((it / opt.burst) * opt.burst / opt.rate);
+		} else {
+			start = (unsigned long)(it / opt.rate);
+		}
+
+		if ((int)wl_below(100) < opt.skew)
+			prio = opt.prio_lo;
+		else
+			prio = opt.prio_lo + wl_below(opt.prio_hi - opt.prio_lo + 1);
+
+		fprintf(file, "%lu %s_%u %d\n", start, argv[optind],
+			wl_below(opt.progs), prio);
+	}
+
+	fclose(file);
+	printf("%s: %d arrivals of %d programs\n", path, opt.procs, opt.progs);
+	return 0;
+}
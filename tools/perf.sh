@@ -0,0 +1,215 @@
+#!/bin/sh
+#
+# Performance regression harness
+#
+#   tools/perf.sh [-n runs] [-t tolerance] [-b baseline] [-u] [config...]
+#
+# Runs every config of input/ (or the given ones) and a few large
+# workloads from wlgen. The timed runs set OS_QUIET, so os skips the
+# memory access trace (IODUMP, PAGETBL_DUMP and the RAM_status.bin
+# dump) and only logs scheduling. The wall time, slots and
+# instructions per second and the peak RSS come from the STATS line os
+# prints on stderr (OS_STATS), best of the runs.
+#
+# A run passes when every loaded process finished and every arrival
+# was loaded. A single CPU config with a golden file in output/ must
+# also reproduce its full trace, from untimed runs with the trace on,
+# repeated up to the run count until one matches. The timer, the
+# loader and the CPU print concurrently, so the lines of each of them
+# are compared in order but not their interleaving. Several CPUs
+# interleave freely, for those only the loaded programs are checked
+# against the golden file. Wall time and peak RSS are compared with
+# the baseline, a config slower or larger than the tolerance is a
+# regression. The exit status is non zero on any failure, trace
+# mismatch or regression, except for the configs of xfail.
+#
+#   -n runs        runs per config, the fastest is kept (default 3)
+#   -t tolerance   allowed slowdown in percent (default 20)
+#   -b baseline    baseline file (default tools/perf.baseline)
+#   -u             rewrite the baseline with this run
+#
+
+cd "$(dirname "$0")/.." || exit 1
+
+runs=3
+tol=20
+baseline=tools/perf.baseline
+update=0
+# Wall time differences below this are noise, in microseconds
+floor_us=5000
+
+while getopts "n:t:b:uh" opt; do
+	case $opt in
+	n) runs=$OPTARG ;;
+	t) tol=$OPTARG ;;
+	b) baseline=$OPTARG ;;
+	u) update=1 ;;
+	*) sed -n '5p' "$0" | sed 's/^# *//' >&2; exit 1 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+[ -x ./os ] && [ -x ./wlgen ] || { echo "perf: build os and wlgen first" >&2; exit 1; }
+
+tmp=$(mktemp -d)
+gen=""
+cleanup() {
+	rm -rf "$tmp"
+	for cfg in $gen; do
+		rm -f "input/$cfg" input/proc/"${cfg}"_*
+	done
+}
+trap cleanup EXIT INT TERM
+
+# Large generated workloads, same seed on every run
+generate() {
+	name=$1; shift
+	./wlgen "$@" "$name" >/dev/null || exit 1
+	gen="$gen $name"
+}
+
+if [ $# -gt 0 ]; then
+	configs="$*"
+else
+	configs=$(for f in input/*; do [ -f "$f" ] && basename "$f"; done)
+	generate perf_wl_uniform -n 1000 -P 16 -c 4 -l 40 -r 0.5 -i 4 -s 1
+	generate perf_wl_poisson -n 10000 -P 32 -c 8 -a poisson -r 20 -l 20 -i 16 -s 2
+	generate perf_wl_burst -n 2000 -P 8 -c 4 -a burst -b 250 -r 50 -l 20 -i 8 \
+		-k 50 -w 1024 -s 3
+	configs="$configs $gen"
+fi
+
+# Known trace mismatches, reported as XFAIL. The MLQ dispatcher stops
+# once its queues are empty, before the later arrivals of these golden
+# files are loaded, and the baseline tree has the same mismatch
+xfail="os_1_singleCPU_mlq os_1_singleCPU_mlq_paging"
+
+# An MLQ build needs the priority field of the arrival records
+needprio=0
+grep -q '^#define MLQ_SCHED' include/os-cfg.h && needprio=1
+
+loaded() {
+	grep -o 'Loaded a process at [^,]*' "$1" | sort
+}
+
+# Trace split by the thread printing it: timer, loader, then the CPU
+streams() {
+	grep '^Time slot' "$1"
+	grep 'Loaded a process at' "$1"
+	grep -v '^Time slot\|Loaded a process at' "$1"
+}
+
+status=0
+: > "$tmp/baseline"
+printf "%-32s %-8s %10s %12s %12s %10s %8s\n" \
+	config result wall_ms slots/s insns/s rss_kb "vs base"
+
+for cfg in $configs; do
+	file=input/$cfg
+	# First arrival record, after the optional memory line
+	fields=$(awk 'NR == 1 || (NR == 2 && !/[^0-9 \t\r]/) { next }
+		{ print NF; exit }' "$file")
+	if [ "$needprio" -eq 1 ] && [ "${fields:-0}" -lt 3 ]; then
+		printf "%-32s %-8s (arrival records have no priority)\n" "$cfg" SKIP
+		continue
+	fi
+
+	# Full trace check, single CPU configs with a golden file only
+	golden=0
+	matched=0
+	if [ -f "output/$cfg.output" ] &&
+	   [ "$(sed -n 1p "$file" | awk '{ print $2 }')" = 1 ]; then
+		streams "output/$cfg.output" > "$tmp/expect"
+		golden=1
+	fi
+
+	# Trace check on logged runs, not timed
+	i=0
+	while [ $golden -eq 1 ] && [ $matched -eq 0 ] && [ $i -lt "$runs" ]; do
+		i=$((i + 1))
+		timeout 300 ./os "$cfg" > "$tmp/out" 2> /dev/null
+		streams "$tmp/out" > "$tmp/trace"
+		if cmp -s "$tmp/expect" "$tmp/trace"; then
+			matched=1
+		else
+			cp "$tmp/trace" "$tmp/mismatch"
+		fi
+	done
+
+	best=""
+	result=ok
+	i=0
+	while [ $i -lt "$runs" ]; do
+		i=$((i + 1))
+		OS_QUIET=1 timeout 300 ./os "$cfg" > "$tmp/out" 2> "$tmp/err"
+		rc=$?
+		stats=$(grep '^STATS' "$tmp/err")
+		if [ $rc -ne 0 ] || [ -z "$stats" ]; then
+			result="rc=$rc"
+			break
+		fi
+		wall=$(echo "$stats" | sed 's/.*wall_us=\([0-9]*\).*/\1/')
+		if [ -z "$best" ] || [ "$wall" -lt "$(echo "$best" | sed 's/.*wall_us=\([0-9]*\).*/\1/')" ]; then
+			best=$stats
+			cp "$tmp/out" "$tmp/best"
+		fi
+	done
+
+	if [ "$result" = ok ]; then
+		loaded "$tmp/best" > "$tmp/got"
+		nloaded=$(wc -l < "$tmp/got")
+		finished=$(grep -c 'has finished' "$tmp/best")
+		if [ "$nloaded" -eq 0 ] || [ "$finished" -ne "$nloaded" ]; then
+			result=FAIL
+		elif [ $golden -eq 1 ]; then
+			[ $matched -eq 1 ] || result=DIFF
+		elif [ -f "output/$cfg.output" ]; then
+			loaded "output/$cfg.output" | uniq > "$tmp/expect"
+			uniq "$tmp/got" | cmp -s "$tmp/expect" - || result=FAIL
+		elif [ "$nloaded" -ne "$(sed -n 1p "$file" | awk '{ print $3 }')" ]; then
+			result=FAIL
+		fi
+	fi
+	case " $xfail " in
+	*" $cfg "*) [ "$result" = DIFF ] && result=XFAIL ;;
+	esac
+	if [ "$result" != ok ]; then
+		printf "%-32s %-8s\n" "$cfg" "$result"
+		# First differing lines of the last mismatching run
+		[ "$result" = DIFF ] && diff "$tmp/expect" "$tmp/mismatch" |
+			sed -n '2,6s/^/    /p'
+		[ "$result" = XFAIL ] || status=1
+		continue
+	fi
+
+	set -- $(echo "$best" | sed 's/[a-z_]*=//g; s/STATS//')
+	slots=$1 insns=$2 wall=$3 rss=$4
+	echo "$cfg $wall $rss" >> "$tmp/baseline"
+
+	cmpbase="-"
+	base=$(awk -v c="$cfg" '$1 == c { print $2, $3 }' "$baseline" 2>/dev/null)
+	if [ -n "$base" ]; then
+		cmpbase=$(echo "$wall $rss $base" | awk -v tol="$tol" -v floor="$floor_us" '{
+			slow = $1 > $3 * (1 + tol / 100) && $1 - $3 > floor
+			big = $2 > $4 * (1 + tol / 100)
+			printf "%+.0f%%%s", ($1 - $3) * 100 / $3, (slow || big) ? "!" : ""
+		}')
+		case $cmpbase in
+		*!) result=SLOW; status=1 ;;
+		esac
+	fi
+
+	echo "$slots $insns $wall $rss" | awk -v c="$cfg" -v r="$result" -v b="$cmpbase" '{
+		printf "%-32s %-8s %10.1f %12.0f %12.0f %10d %8s\n",
+			c, r, $3 / 1000, $1 * 1e6 / $3, $2 * 1e6 / $3, $4, b
+	}'
+done
+
+if [ $update -eq 1 ]; then
+	# Keep the entries of the configs not run this time
+	awk 'NR == FNR { run[$1] = 1; next } !($1 in run)' \
+		"$tmp/baseline" "$baseline" 2>/dev/null > "$tmp/keep"
+	sort "$tmp/baseline" "$tmp/keep" > "$baseline"
+	echo "perf: baseline written to $baseline"
+fi
+exit $status